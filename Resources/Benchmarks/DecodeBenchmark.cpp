@@ -0,0 +1,173 @@
+// Micro-benchmark for the sample decode kernels in Source/SampleDecoder.cpp
+//
+// Build with the plugin:  cmake -DBUILD_BENCHMARKS=ON .. && make decode_benchmark
+// Usage: decode_benchmark [frames per block] [milliseconds per measurement]
+//
+// For every channel count from 1 to MAX_DATA_CHANNELS and every int16 kernel
+// this CPU supports, reports decoded samples/s and the equivalent per-channel
+// sample rate a single core could sustain. The kernels of the other sample
+// formats are then checked against the values encoded and timed at 32 and
+// MAX_DATA_CHANNELS channels.
+
+#include "SampleDecoder.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace SampleDecoder;
+
+static const char* const formatNames[NUM_SAMPLE_FORMATS] = {
+    "int16le", "int16be", "int24le", "int24be", "int32le", "int32be", "f32le", "f32be"
+};
+
+/** Encodes random int16-range values in format into every channel of frames; returns the values */
+static std::vector<float> fillFrames (std::vector<SampleFrame>& frames, PacketSampleFormat format, std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> dist (-32768, 32767);
+    const size_t sampleSize = getSampleSize ((uint8_t) format);
+    std::vector<float> values;
+
+    for (auto& frame : frames)
+    {
+        frame.format = (uint8_t) format;
+
+        for (int ch = 0; ch < MAX_DATA_CHANNELS; ch++)
+        {
+            const int value = dist (rng);
+            writeSample (reinterpret_cast<char*> (frame.samples) + ch * sampleSize, format, value);
+            values.push_back ((float) value);
+        }
+    }
+
+    return values;
+}
+
+/** Per-channel calibration, different for every channel so a kernel that mixes them up shows */
+static std::vector<float> gains (MAX_DATA_CHANNELS);
+static std::vector<float> offsets (MAX_DATA_CHANNELS);
+
+/** Runs kernel repeatedly for measureMs and returns decoded samples per second */
+static double measure (DecodeFunction kernel, const std::vector<SampleFrame>& frames, int channels, std::vector<float>& dest, int measureMs)
+{
+    using clock = std::chrono::steady_clock;
+    const int numFrames = (int) frames.size();
+    const auto deadline = clock::now() + std::chrono::milliseconds (measureMs);
+    const auto start = clock::now();
+    long long blocks = 0;
+
+    while (clock::now() < deadline)
+    {
+        for (int rep = 0; rep < 16; rep++)
+            kernel (frames.data(), numFrames, channels, gains.data(), offsets.data(), dest.data(), numFrames);
+
+        blocks += 16;
+    }
+
+    const double seconds = std::chrono::duration<double> (clock::now() - start).count();
+    return (double) blocks * numFrames * channels / seconds;
+}
+
+static bool matchesScalar (DecodeFunction kernel,
+                           const std::vector<SampleFrame>& frames,
+                           int numFrames,
+                           int channels)
+{
+    std::vector<float> expected ((size_t) channels * numFrames);
+    std::vector<float> actual ((size_t) channels * numFrames);
+
+    getKernel (Kernel::SCALAR) (frames.data(), numFrames, channels, gains.data(), offsets.data(), expected.data(), numFrames);
+    kernel (frames.data(), numFrames, channels, gains.data(), offsets.data(), actual.data(), numFrames);
+
+    return expected == actual;
+}
+
+int main (int argc, char** argv)
+{
+    const int numFrames = argc > 1 ? std::atoi (argv[1]) : 1024;
+    const int measureMs = argc > 2 ? std::atoi (argv[2]) : 200;
+
+    for (int ch = 0; ch < MAX_DATA_CHANNELS; ch++)
+    {
+        gains[ch] = 0.195f * (1.0f + ch / 256.0f);
+        offsets[ch] = ch - 64.0f;
+    }
+
+    std::vector<SampleFrame> frames (numFrames);
+    std::mt19937 rng (42);
+    fillFrames (frames, PacketSampleFormat::INT16_LE, rng);
+
+    std::vector<float> dest ((size_t) MAX_DATA_CHANNELS * numFrames);
+
+    std::printf ("best kernel: %s, %d frames per block\n\n", getKernelName (getBestKernel()), numFrames);
+    std::printf ("%8s %8s %14s %16s\n", "channels", "kernel", "Msamples/s", "max rate/ch (kHz)");
+
+    const Kernel kernels[] = { Kernel::SCALAR, Kernel::SSE2, Kernel::AVX2 };
+
+    for (int channels = 1; channels <= MAX_DATA_CHANNELS; channels = channels < 8 ? channels + 1 : channels * 2)
+    {
+        for (Kernel k : kernels)
+        {
+            DecodeFunction kernel = getKernel (k);
+
+            if (kernel == nullptr)
+                continue;
+
+            // Odd frame counts exercise the scalar edges of the vector kernels
+            if (! matchesScalar (kernel, frames, numFrames - 3, channels))
+            {
+                std::printf ("%8d %8s   MISMATCH against scalar kernel\n", channels, getKernelName (k));
+                return 1;
+            }
+
+            const double samplesPerSecond = measure (kernel, frames, channels, dest, measureMs);
+
+            std::printf ("%8d %8s %14.1f %16.1f\n",
+                         channels,
+                         getKernelName (k),
+                         samplesPerSecond / 1e6,
+                         samplesPerSecond / channels / 1e3);
+        }
+    }
+
+    std::printf ("\n%8s %8s %14s %16s\n", "channels", "format", "Msamples/s", "max rate/ch (kHz)");
+
+    for (int f = 0; f < NUM_SAMPLE_FORMATS; f++)
+    {
+        const std::vector<float> values = fillFrames (frames, (PacketSampleFormat) f, rng);
+        DecodeFunction kernel = getFormatKernel ((uint8_t) f);
+
+        // Every format carries the same int16-range values exactly, so calibrates to the same result
+        kernel (frames.data(), numFrames, MAX_DATA_CHANNELS, gains.data(), offsets.data(), dest.data(), numFrames);
+
+        for (int i = 0; i < numFrames; i++)
+        {
+            for (int ch = 0; ch < MAX_DATA_CHANNELS; ch++)
+            {
+                const float expected = values[(size_t) i * MAX_DATA_CHANNELS + ch] * gains[ch] + offsets[ch];
+
+                if (dest[(size_t) ch * numFrames + i] != expected)
+                {
+                    std::printf ("%8s   MISMATCH at frame %d channel %d\n", formatNames[f], i, ch);
+                    return 1;
+                }
+            }
+        }
+
+        for (int channels : { 32, MAX_DATA_CHANNELS })
+        {
+            const double samplesPerSecond = measure (kernel, frames, channels, dest, measureMs);
+
+            std::printf ("%8d %8s %14.1f %16.1f\n",
+                         channels,
+                         formatNames[f],
+                         samplesPerSecond / 1e6,
+                         samplesPerSecond / channels / 1e3);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,551 @@
+// End-to-end benchmark of the receive path: UdpReceiver, PacketSequencer and
+// SampleDecoder, driven the same way DataThreadPlugin::updateBuffer() does,
+// without the Open Ephys GUI.
+//
+// Build with the plugin:  cmake -DBUILD_BENCHMARKS=ON .. && make receive_benchmark
+// Usage: receive_benchmark [--channels N] [--spp N] [--rate PACKETS_PER_S] [--seconds S]
+//                          [--senders N] [--receivers N] [--burst N] [--batch N]
+//                          [--block N] [--target-latency US] [--port N] [--capture DIR]
+//                          [--backend epoll|io_uring] [--gso 0|1] [--gro 0|1]
+//                          [--rcvbuf KB] [--busy-poll US] [--cpu N] [--priority N]
+//                          [--format 0-7] [--multicast GROUP] [--bind ADDRESS] [--to ADDRESS]
+//
+// Sender threads blast Header protocol datagrams over loopback. Every frame
+// carries its send time in channels 0-3, so the stub DataBuffer can measure
+// the latency from sendmmsg() to addToBuffer() of every sample frame.
+// --rate is per sender; 0 sends as fast as possible. Sequence numbers are
+// tracked per receiver, so use as many receivers as senders; the kernel may
+// still hash two senders onto one receiver, which then discards packets.
+// --capture also records every datagram to capture files in DIR, to measure
+// what recording costs the live path.
+//
+// --gso 1 sends each burst as one UDP_SEGMENT send, which loopback hands to
+// a UDP_GRO socket still coalesced, as a NIC with GRO would (--gro 0 turns
+// GRO off on the receive side).
+//
+// "receive cpu" is the CPU time of the whole process minus that of the
+// sender and consumer threads, i.e. what the receiver threads spent per
+// packet, to compare the receive backends.
+//
+// --format sends samples in another PacketSampleFormat (see PacketHeader.h)
+// to compare the decode kernels end to end.
+//
+// --multicast sends to an IPv4 multicast group instead, which the receiver
+// joins; the kernel loops the group's datagrams back to local members.
+// --bind sets the receivers' bind address ("::" for dual-stack) and --to
+// the address senders send to (default 127.0.0.1), e.g. --bind :: --to ::1.
+//
+// --streams splits the senders' packets into that many sender streams, one
+// per sender socket, to measure the cost of looking senders up; senders
+// beyond the streams are counted as unrouted.
+//
+// --cpu pins the receivers to cores from N on and --priority runs them
+// SCHED_FIFO; "scheduling" shows what they were actually granted.
+//
+// With --target-latency the benchmark exits with status 2 if the p99
+// latency exceeds the target, e.g. --spp 1 --rate 30000 --target-latency
+// 100000 checks that a target longer than one consumer block (1024 frames,
+// 34 ms at 30 kHz) is still met.
+
+#include "PacketHeader.h"
+#include "UdpReceiver.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int64_t steadyNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t cpuTimeNs (clockid_t clock)
+{
+    timespec ts;
+    clock_gettime (clock, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+    Log-linear latency histogram: 16 buckets per power of two, so any
+    percentile is resolved to within about 6%.
+*/
+class LatencyHistogram
+{
+public:
+    void add (int64_t ns)
+    {
+        counts[bucketOf (std::max<int64_t> (ns, 0))]++;
+        total++;
+        maxNs = std::max (maxNs, ns);
+    }
+
+    /** Upper bound of the bucket holding the given quantile, in ns */
+    int64_t percentile (double quantile) const
+    {
+        const uint64_t rank = (uint64_t) std::ceil (quantile * total);
+        uint64_t seen = 0;
+
+        for (int b = 0; b < NUM_BUCKETS; b++)
+        {
+            seen += counts[b];
+            if (seen >= rank && seen > 0)
+                return std::min (upperBound (b), maxNs);
+        }
+
+        return maxNs;
+    }
+
+    uint64_t count() const { return total; }
+    int64_t max() const { return maxNs; }
+
+private:
+    static constexpr int SUB_BITS = 4;
+    static constexpr int NUM_BUCKETS = 64 << SUB_BITS;
+
+    static int bucketOf (int64_t ns)
+    {
+        if (ns < (1 << SUB_BITS))
+            return (int) ns;
+
+        const int group = 63 - __builtin_clzll ((uint64_t) ns); // >= SUB_BITS
+        const int sub = (int) ((ns >> (group - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+        return ((group - SUB_BITS + 1) << SUB_BITS) + sub;
+    }
+
+    static int64_t upperBound (int bucket)
+    {
+        if (bucket < (1 << SUB_BITS))
+            return bucket;
+
+        const int group = (bucket >> SUB_BITS) + SUB_BITS - 1;
+        const int64_t sub = bucket & ((1 << SUB_BITS) - 1);
+        return ((((int64_t) 1 << SUB_BITS) + sub + 1) << (group - SUB_BITS)) - 1;
+    }
+
+    uint64_t counts[NUM_BUCKETS] = {};
+    uint64_t total = 0;
+    int64_t maxNs = 0;
+};
+
+static LatencyHistogram latency;
+static int64_t deliveredFrames = 0;
+static std::atomic<int64_t> senderCpuNs { 0 }; // CPU time of threads that are not receivers
+
+DataBuffer::DataBuffer (int numChannels_, int) : numChannels (numChannels_)
+{
+}
+
+int DataBuffer::addToBuffer (float* data, int64*, double*, uint64*, int numItems, int)
+{
+    const int64_t now = steadyNowNs();
+
+    // Samples are channel-major; channels 0-3 hold the 16-bit parts of the send time
+    for (int i = 0; i < numItems; i++)
+    {
+        uint64_t sent = 0;
+        for (int part = 0; part < 4; part++)
+            sent |= (uint64_t) (uint16_t) (int16_t) std::lrint (data[part * numItems + i]) << (16 * part);
+
+        latency.add (now - (int64_t) sent);
+    }
+
+    deliveredFrames += numItems;
+    return numItems;
+}
+
+struct Options
+{
+    int channels = 32;
+    int samplesPerPacket = 16;
+    double rate = 2000;   // packets per second per sender, 0 = unpaced
+    double seconds = 5;
+    int senders = 1;
+    int receivers = 1;
+    int burst = 1;        // datagrams per sendmmsg call
+    int batch = 16;       // datagrams per recvmmsg call
+    int block = 300;      // "packet_hold"
+    int targetLatency = 0; // "target_latency", microseconds
+    int port = 9090;
+    std::string capture;  // capture directory, empty = no capture
+    int backend = BACKEND_EPOLL;
+    bool gso = false;     // send bursts as UDP_SEGMENT super-datagrams
+    bool gro = true;
+    int receiveBufferKb = 0; // "receive_buffer", 0 = system default
+    int busyPollUs = 0;      // "busy_poll"
+    int cpu = -1;            // "receiver_cpu"
+    int priority = 0;        // "receiver_priority"
+    PacketSampleFormat format = PacketSampleFormat::INT16_LE;
+    std::string multicast;   // "multicast_group", empty = unicast over loopback
+    std::string bind;        // "bind_address"
+    std::string to = "127.0.0.1"; // where unicast senders send
+    int streams = 1;         // "streams"
+};
+
+static void usage()
+{
+    std::fprintf (stderr,
+                  "usage: receive_benchmark [--channels N] [--spp N] [--rate PACKETS_PER_S] [--seconds S]\n"
+                  "                         [--senders N] [--receivers N] [--burst N] [--batch N]\n"
+                  "                         [--block N] [--target-latency US] [--port N] [--capture DIR]\n"
+                  "                         [--backend epoll|io_uring] [--gso 0|1] [--gro 0|1]\n"
+                  "                         [--rcvbuf KB] [--busy-poll US] [--cpu N] [--priority N]\n"
+                  "                         [--format 0-7] [--multicast GROUP] [--bind ADDRESS] [--to ADDRESS]\n"
+                  "                         [--streams N]\n");
+    std::exit (1);
+}
+
+static Options parseOptions (int argc, char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string name = argv[i];
+        if (i + 1 >= argc)
+            usage();
+        const char* value = argv[++i];
+
+        if (name == "--channels")
+            options.channels = std::atoi (value);
+        else if (name == "--spp")
+            options.samplesPerPacket = std::atoi (value);
+        else if (name == "--rate")
+            options.rate = std::atof (value);
+        else if (name == "--seconds")
+            options.seconds = std::atof (value);
+        else if (name == "--senders")
+            options.senders = std::atoi (value);
+        else if (name == "--receivers")
+            options.receivers = std::atoi (value);
+        else if (name == "--burst")
+            options.burst = std::atoi (value);
+        else if (name == "--batch")
+            options.batch = std::atoi (value);
+        else if (name == "--block")
+            options.block = std::atoi (value);
+        else if (name == "--target-latency")
+            options.targetLatency = std::atoi (value);
+        else if (name == "--port")
+            options.port = std::atoi (value);
+        else if (name == "--capture")
+            options.capture = value;
+        else if (name == "--backend")
+            options.backend = std::string (value) == "io_uring" ? BACKEND_IO_URING : BACKEND_EPOLL;
+        else if (name == "--gso")
+            options.gso = std::atoi (value) != 0;
+        else if (name == "--gro")
+            options.gro = std::atoi (value) != 0;
+        else if (name == "--rcvbuf")
+            options.receiveBufferKb = std::atoi (value);
+        else if (name == "--busy-poll")
+            options.busyPollUs = std::atoi (value);
+        else if (name == "--cpu")
+            options.cpu = std::atoi (value);
+        else if (name == "--priority")
+            options.priority = std::atoi (value);
+        else if (name == "--format")
+            options.format = (PacketSampleFormat) std::clamp (std::atoi (value), 0, NUM_SAMPLE_FORMATS - 1);
+        else if (name == "--multicast")
+            options.multicast = value;
+        else if (name == "--bind")
+            options.bind = value;
+        else if (name == "--to")
+            options.to = value;
+        else if (name == "--streams")
+            options.streams = std::atoi (value);
+        else
+            usage();
+    }
+
+    options.channels = std::clamp (options.channels, 4, MAX_DATA_CHANNELS);
+    options.samplesPerPacket = std::clamp (options.samplesPerPacket, 1, 256);
+    options.senders = std::max (options.senders, 1);
+    options.burst = std::clamp (options.burst, 1, 64);
+    options.streams = std::clamp (options.streams, 1, SenderStreams::MAX_STREAMS);
+
+    // A UDP_SEGMENT send carries at most 64 KB
+    const size_t packetSize = sizeof (PacketHeader) + (size_t) options.channels * options.samplesPerPacket * sizeof (int16_t);
+    if (options.gso)
+        options.burst = std::clamp ((int) (65507 / packetSize), 1, options.burst);
+
+    return options;
+}
+
+/** Sends paced bursts of Header protocol packets until deadlineNs; returns packets sent */
+static int64_t sendPackets (const Options& options, int64_t deadlineNs)
+{
+    addrinfo hints {};
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+    addrinfo* destination = nullptr;
+    const std::string host = options.multicast.empty() ? options.to : options.multicast;
+    if (getaddrinfo (host.c_str(), std::to_string (options.port).c_str(), &hints, &destination) != 0)
+    {
+        std::fprintf (stderr, "cannot send to %s\n", host.c_str());
+        return 0;
+    }
+
+    int sock = socket (destination->ai_family, SOCK_DGRAM, 0);
+    connect (sock, destination->ai_addr, destination->ai_addrlen);
+    freeaddrinfo (destination);
+
+    const size_t sampleSize = getSampleSize ((uint8_t) options.format);
+    const size_t packetSize = sizeof (PacketHeader) + (size_t) options.channels * options.samplesPerPacket * sampleSize;
+
+    const int segmentSize = (int) packetSize;
+    if (options.gso && setsockopt (sock, SOL_UDP, UDP_SEGMENT, &segmentSize, sizeof (segmentSize)) == -1)
+        std::fprintf (stderr, "UDP_SEGMENT unavailable\n");
+
+    std::vector<char> packets (packetSize * options.burst);
+    std::vector<iovec> iovecs (options.burst);
+    std::vector<mmsghdr> msgs (options.burst);
+
+    for (int k = 0; k < options.burst; k++)
+    {
+        iovecs[k].iov_base = packets.data() + k * packetSize;
+        iovecs[k].iov_len = packetSize;
+        msgs[k].msg_hdr.msg_iov = &iovecs[k];
+        msgs[k].msg_hdr.msg_iovlen = 1;
+    }
+
+    const int64_t burstPeriodNs = options.rate > 0 ? (int64_t) (1e9 * options.burst / options.rate) : 0;
+    int64_t nextBurst = steadyNowNs();
+    uint64_t sequence = 0;
+    int64_t sent = 0;
+
+    while (steadyNowNs() < deadlineNs)
+    {
+        if (burstPeriodNs > 0)
+        {
+            // Sleep for most of the gap, spin for the rest
+            int64_t wait = nextBurst - steadyNowNs();
+            if (wait > 100000)
+                std::this_thread::sleep_for (std::chrono::nanoseconds (wait - 50000));
+            while (steadyNowNs() < nextBurst)
+                ;
+            nextBurst += burstPeriodNs;
+        }
+
+        const int64_t now = steadyNowNs();
+
+        for (int k = 0; k < options.burst; k++)
+        {
+            char* packet = packets.data() + k * packetSize;
+            writePacketHeader (packet, sequence + k, (uint64_t) now, options.channels, options.samplesPerPacket,
+                               options.format);
+
+            if (options.format == PacketSampleFormat::INT16_LE)
+            {
+                int16_t* samples = reinterpret_cast<int16_t*> (packet + sizeof (PacketHeader));
+                for (int frame = 0; frame < options.samplesPerPacket; frame++)
+                {
+                    int16_t* s = samples + frame * options.channels;
+                    for (int part = 0; part < 4; part++)
+                        s[part] = (int16_t) (uint16_t) ((uint64_t) now >> (16 * part));
+                    for (int ch = 4; ch < options.channels; ch++)
+                        s[ch] = (int16_t) (ch + frame);
+                }
+            }
+            else
+            {
+                // Same values, encoded one by one
+                char* s = packet + sizeof (PacketHeader);
+                for (int frame = 0; frame < options.samplesPerPacket; frame++)
+                {
+                    for (int ch = 0; ch < options.channels; ch++, s += sampleSize)
+                        writeSample (s, options.format,
+                                     ch < 4 ? (int16_t) (uint16_t) ((uint64_t) now >> (16 * ch)) : (int16_t) (ch + frame));
+                }
+            }
+        }
+
+        int result;
+        if (options.gso)
+            result = send (sock, packets.data(), packetSize * options.burst, 0) > 0 ? options.burst : -1;
+        else
+            result = sendmmsg (sock, msgs.data(), options.burst, 0);
+
+        if (result > 0)
+        {
+            sequence += result;
+            sent += result;
+        }
+    }
+
+    close (sock);
+
+    senderCpuNs += cpuTimeNs (CLOCK_THREAD_CPUTIME_ID);
+    return sent;
+}
+
+int main (int argc, char** argv)
+{
+    const Options options = parseOptions (argc, argv);
+
+    UdpReceiver::Settings settings;
+    settings.port = options.port;
+    settings.channels = options.channels;
+    settings.protocol = PROTOCOL_HEADER;
+    settings.batchSize = options.batch;
+    settings.receivers = options.receivers;
+    settings.gapPolicy = PacketSequencer::GAP_SKIP; // only count frames that arrived
+    settings.backend = options.backend;
+    settings.gro = options.gro;
+    settings.receiveBufferKb = options.receiveBufferKb;
+    settings.busyPollUs = options.busyPollUs;
+    settings.receiverCpu = options.cpu;
+    settings.receiverPriority = options.priority;
+    settings.multicastGroup = options.multicast;
+    settings.bindAddress = options.bind;
+    settings.streams = options.streams;
+
+    PacketRecorder recorder;
+    if (! options.capture.empty())
+    {
+        if (! recorder.start (options.capture, 256 << 20, options.receivers, PROTOCOL_HEADER))
+        {
+            std::fprintf (stderr, "cannot create capture files in %s\n", options.capture.c_str());
+            return 1;
+        }
+    }
+
+    // Same limit as DataThreadPlugin::updateBuffer()
+    constexpr int MAX_BLOCK = 1024;
+
+    UdpReceiver receiver;
+    receiver.setRecorder (recorder.isRecording() ? &recorder : nullptr);
+    receiver.setBlockSize (options.block);
+    receiver.setTargetLatency (options.targetLatency);
+    receiver.setMaxBlockSize (MAX_BLOCK);
+    receiver.start (settings);
+
+    DataBuffer dataBuffer (options.channels, 48000);
+
+    // Same loop as DataThreadPlugin::updateBuffer()
+    std::vector<float> dataPoints ((size_t) options.streams * MAX_DATA_CHANNELS * MAX_BLOCK);
+    std::vector<int64> sampleNumbers ((size_t) options.streams * MAX_BLOCK);
+    std::vector<double> timestamps ((size_t) options.streams * MAX_BLOCK);
+    std::vector<uint64> eventCodes (MAX_BLOCK);
+    const std::vector<float> gains (MAX_DATA_CHANNELS, 1.0f);
+    const std::vector<float> offsets (MAX_DATA_CHANNELS, 0.0f);
+    std::atomic<bool> consuming { true };
+
+    std::vector<UdpReceiver::StreamBlock> blocks (options.streams);
+    for (int st = 0; st < options.streams; st++)
+    {
+        blocks[st].dest = dataPoints.data() + (size_t) st * MAX_DATA_CHANNELS * MAX_BLOCK;
+        blocks[st].sampleNumbers = sampleNumbers.data() + (size_t) st * MAX_BLOCK;
+        blocks[st].timestamps = timestamps.data() + (size_t) st * MAX_BLOCK;
+        blocks[st].gains = gains.data();
+        blocks[st].offsets = offsets.data();
+    }
+
+    std::thread consumer ([&]
+    {
+        while (consuming)
+        {
+            const int available = receiver.getQueuedFrames();
+            if ((available == 0 || available < receiver.getFlushThreshold()) && ! receiver.waitForFrames (100))
+                continue;
+
+            receiver.readBlock (blocks.data(), MAX_BLOCK);
+
+            for (const UdpReceiver::StreamBlock& block : blocks)
+            {
+                if (block.numFrames > 0)
+                    dataBuffer.addToBuffer (block.dest, block.sampleNumbers, block.timestamps, eventCodes.data(), block.numFrames);
+            }
+        }
+
+        senderCpuNs += cpuTimeNs (CLOCK_THREAD_CPUTIME_ID);
+    });
+
+    // Give the receivers time to bind
+    std::this_thread::sleep_for (std::chrono::milliseconds (100));
+
+    const int64_t start = steadyNowNs();
+    const int64_t startCpu = cpuTimeNs (CLOCK_PROCESS_CPUTIME_ID);
+    const int64_t deadline = start + (int64_t) (options.seconds * 1e9);
+
+    std::vector<std::thread> senders;
+    std::vector<int64_t> sentPackets (options.senders);
+
+    for (int s = 0; s < options.senders; s++)
+        senders.emplace_back ([&, s] { sentPackets[s] = sendPackets (options, deadline); });
+
+    for (auto& sender : senders)
+        sender.join();
+
+    const double elapsed = (steadyNowNs() - start) * 1e-9;
+
+    // Let the receivers drain, then stop everything
+    std::this_thread::sleep_for (std::chrono::milliseconds (200));
+    consuming = false;
+    receiver.wakeConsumer();
+    consumer.join();
+
+    const int64_t stopStart = steadyNowNs();
+    receiver.stop();
+    const int64_t stopNs = steadyNowNs() - stopStart;
+    const int64_t receiveCpu = cpuTimeNs (CLOCK_PROCESS_CPUTIME_ID) - startCpu - senderCpuNs;
+    recorder.stop();
+
+    int64_t packets = 0;
+    for (int64_t p : sentPackets)
+        packets += p;
+
+    const int64_t sentFrames = packets * options.samplesPerPacket;
+    const UdpReceiver::Counters counters = receiver.getCounters();
+
+    std::printf ("%d channels, %d frames/packet, %d sender(s), %d receiver(s), %.1f s\n",
+                 options.channels, options.samplesPerPacket, options.senders, options.receivers, elapsed);
+    std::printf ("sent       %12lld packets  %10.3f Msamples/s\n",
+                 (long long) packets, sentFrames * (double) options.channels / elapsed * 1e-6);
+    std::printf ("delivered  %12lld frames   %10.3f Msamples/s\n",
+                 (long long) deliveredFrames, deliveredFrames * (double) options.channels / elapsed * 1e-6);
+    std::printf ("dropped    %12.4f %%        kernel: %lld packets, queue full: %lld frames, lost: %lld, late: %lld, duplicate: %lld packets\n",
+                 sentFrames > 0 ? 100.0 * (sentFrames - deliveredFrames) / sentFrames : 0.0,
+                 (long long) counters.kernelDrops, (long long) counters.droppedFrames, (long long) counters.lostPackets,
+                 (long long) counters.latePackets, (long long) counters.duplicatePackets);
+    std::printf ("latency    p50 %.1f us  p99 %.1f us  p999 %.1f us  max %.1f us\n",
+                 latency.percentile (0.5) * 1e-3, latency.percentile (0.99) * 1e-3,
+                 latency.percentile (0.999) * 1e-3, latency.max() * 1e-3);
+
+    std::printf ("receive cpu %8.2f us/packet  %5.1f %% of a core\n",
+                 packets > 0 ? receiveCpu * 1e-3 / packets : 0.0, 100.0 * receiveCpu * 1e-9 / elapsed);
+
+    std::printf ("stop       %8.1f us to join the receiver threads\n", stopNs * 1e-3);
+
+    if (options.streams > 1)
+        std::printf ("streams    %d, unrouted: %lld packets\n", options.streams, (long long) counters.unroutedPackets);
+
+    if (options.cpu >= 0 || options.priority > 0)
+        std::printf ("scheduling %s\n", describeThreadScheduling (receiver.getScheduling()).c_str());
+
+    if (! options.capture.empty())
+        std::printf ("captured   %12lld packets not recorded (writer behind)\n", (long long) recorder.getDroppedPackets());
+
+    if (options.targetLatency > 0 && latency.percentile (0.99) > options.targetLatency * 1000LL)
+    {
+        std::printf ("target     p99 above the %d us target\n", options.targetLatency);
+        return 2;
+    }
+
+    return 0;
+}
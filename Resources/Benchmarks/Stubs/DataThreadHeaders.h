@@ -0,0 +1,42 @@
+// Minimal stand-in for the Open Ephys <DataThreadHeaders.h>, so the receive
+// path (UdpReceiver, PacketSequencer, SampleDecoder) builds without the GUI.
+// Only what those sources use is declared here; DataBuffer is defined by the
+// benchmark itself, which measures what arrives in addToBuffer().
+
+#ifndef BENCHMARK_DATATHREADHEADERS_H_DEFINED
+#define BENCHMARK_DATATHREADHEADERS_H_DEFINED
+
+#include <cstdint>
+#include <iostream>
+
+typedef long long int64;           // as juce::int64
+typedef unsigned long long uint64; // as juce::uint64
+
+/** Debug logging is compiled out, as it would be in a release build of the GUI */
+template <typename... Args>
+inline void LOGD (Args&&...)
+{
+}
+
+/** Console messages, such as refused thread scheduling, go to stderr */
+template <typename... Args>
+inline void LOGC (Args&&... args)
+{
+    (std::cerr << ... << args) << std::endl;
+}
+
+/** Receives blocks the same way the GUI's DataBuffer does */
+class DataBuffer
+{
+public:
+    DataBuffer (int numChannels, int size);
+
+    int addToBuffer (float* data, int64* sampleNumbers, double* timestamps, uint64* eventCodes, int numItems, int chunkSize = 1);
+
+    void clear() {}
+
+private:
+    int numChannels;
+};
+
+#endif
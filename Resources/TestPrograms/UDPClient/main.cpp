@@ -0,0 +1,374 @@
+// Traffic generator for the UDP Packet Reader plugin
+//
+// Build with the plugin:  cmake -DBUILD_BENCHMARKS=ON .. && make udp_client
+// or on its own:          g++ -O2 -std=c++17 -pthread -I../../../Source main.cpp -o udp_client
+//
+// Sends sine waves (one phase per channel) in real time at the given sample
+// rate, in Raw or Header protocol datagrams. Packets are paced against an
+// absolute schedule, so the average rate stays exact however long it runs;
+// --burst sends that many packets back to back with one sendmmsg() call and
+// then pauses for as long as they last. --loss, --reorder and --duplicate
+// inject faults (Header protocol only, Raw has no sequence numbers).
+//
+// Every --senders thread has its own socket and sequence numbers and sends
+// the full rate, e.g. to exercise several receivers.
+
+#include "PacketHeader.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    bool header = true;          // Header protocol, otherwise Raw
+    int channels = 128;
+    double sampleRate = 30000;
+    int samplesPerPacket = 16;   // forced to 1 with Raw
+    int burst = 1;               // packets per sendmmsg() call
+    double seconds = 0;          // 0 = until interrupted
+    double frequency = 0.25;     // Hz
+    double loss = 0;             // probability a packet is not sent
+    double reorder = 0;          // probability a packet swaps places with the next one
+    double duplicate = 0;        // probability a packet is sent twice
+    int senders = 1;
+    unsigned seed = 1;
+};
+
+/** Totals over all sender threads, printed once per second */
+struct Stats
+{
+    std::atomic<int64_t> packets { 0 };
+    std::atomic<int64_t> frames { 0 };
+    std::atomic<int64_t> dropped { 0 };
+    std::atomic<int64_t> reordered { 0 };
+    std::atomic<int64_t> duplicated { 0 };
+    std::atomic<int64_t> errors { 0 };
+    std::atomic<int64_t> behind { 0 }; // bursts that started after their slot
+};
+
+static Stats stats;
+static std::atomic<bool> running { true };
+
+static void usage()
+{
+    std::fprintf (stderr,
+                  "usage: udp_client [--host ADDR] [--port N] [--protocol raw|header] [--channels N]\n"
+                  "                  [--rate HZ] [--spp N] [--burst N] [--seconds S] [--frequency HZ]\n"
+                  "                  [--loss P] [--reorder P] [--duplicate P] [--senders N] [--seed N]\n");
+    std::exit (1);
+}
+
+static Options parseOptions (int argc, char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string name = argv[i];
+        if (i + 1 >= argc)
+            usage();
+        const std::string value = argv[++i];
+
+        if (name == "--host")
+            options.host = value;
+        else if (name == "--port")
+            options.port = std::stoi (value);
+        else if (name == "--protocol")
+            options.header = value != "raw";
+        else if (name == "--channels")
+            options.channels = std::stoi (value);
+        else if (name == "--rate")
+            options.sampleRate = std::stod (value);
+        else if (name == "--spp")
+            options.samplesPerPacket = std::stoi (value);
+        else if (name == "--burst")
+            options.burst = std::stoi (value);
+        else if (name == "--seconds")
+            options.seconds = std::stod (value);
+        else if (name == "--frequency")
+            options.frequency = std::stod (value);
+        else if (name == "--loss")
+            options.loss = std::stod (value);
+        else if (name == "--reorder")
+            options.reorder = std::stod (value);
+        else if (name == "--duplicate")
+            options.duplicate = std::stod (value);
+        else if (name == "--senders")
+            options.senders = std::stoi (value);
+        else if (name == "--seed")
+            options.seed = (unsigned) std::stoul (value);
+        else
+            usage();
+    }
+
+    options.channels = std::clamp (options.channels, 1, 4096);
+    options.samplesPerPacket = options.header ? std::clamp (options.samplesPerPacket, 1, 65535) : 1;
+    options.burst = std::clamp (options.burst, 1, 1024);
+    options.senders = std::max (options.senders, 1);
+
+    const size_t payload = (options.header ? sizeof (PacketHeader) : 0)
+                           + (size_t) options.channels * options.samplesPerPacket * sizeof (int16_t);
+    if (payload > 65507)
+    {
+        std::fprintf (stderr, "packets of %zu bytes do not fit a UDP datagram\n", payload);
+        std::exit (1);
+    }
+
+    if (options.sampleRate <= 0)
+        usage();
+
+    return options;
+}
+
+static int64_t monotonicNs()
+{
+    timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int64_t realtimeNs()
+{
+    timespec ts;
+    clock_gettime (CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/** Sleeps until the CLOCK_MONOTONIC time deadlineNs; the last stretch is spun for precision */
+static void waitUntil (int64_t deadlineNs)
+{
+    constexpr int64_t SPIN_NS = 50000;
+
+    if (deadlineNs - monotonicNs() > SPIN_NS)
+    {
+        const int64_t wake = deadlineNs - SPIN_NS;
+        timespec ts { (time_t) (wake / 1000000000LL), (long) (wake % 1000000000LL) };
+        clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+    }
+
+    while (monotonicNs() < deadlineNs)
+        ;
+}
+
+/** Sine table shared by all channels; each channel reads it at its own phase */
+class Waveform
+{
+public:
+    Waveform() : table (SIZE)
+    {
+        for (int i = 0; i < SIZE; i++)
+            table[i] = (int16_t) (std::sin (2 * M_PI * i / SIZE) * 32766);
+    }
+
+    /** Writes numFrames frames, frame-major, starting at sample index firstSample */
+    void render (int16_t* dest, int64_t firstSample, int numFrames, int channels, double cyclesPerSample) const
+    {
+        // Channel i leads by 0.15 rad, as in the original test client
+        const double channelPhase = 0.15 / (2 * M_PI);
+
+        for (int frame = 0; frame < numFrames; frame++)
+        {
+            const double phase = std::fmod ((firstSample + frame) * cyclesPerSample, 1.0);
+
+            for (int ch = 0; ch < channels; ch++)
+            {
+                const double p = phase + ch * channelPhase;
+                dest[frame * channels + ch] = table[(int) ((p - std::floor (p)) * SIZE) & (SIZE - 1)];
+            }
+        }
+    }
+
+private:
+    static constexpr int SIZE = 4096;
+    std::vector<int16_t> table;
+};
+
+static void runSender (const Options& options, int senderIndex)
+{
+    int sock = socket (AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+    {
+        perror ("socket");
+        return;
+    }
+
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (options.port);
+    if (inet_pton (AF_INET, options.host.c_str(), &addr.sin_addr) != 1 || connect (sock, (sockaddr*) &addr, sizeof (addr)) < 0)
+    {
+        std::fprintf (stderr, "cannot send to %s:%d\n", options.host.c_str(), options.port);
+        close (sock);
+        return;
+    }
+
+    const int spp = options.samplesPerPacket;
+    const size_t headerSize = options.header ? sizeof (PacketHeader) : 0;
+    const size_t packetSize = headerSize + (size_t) options.channels * spp * sizeof (int16_t);
+    const double cyclesPerSample = options.frequency / options.sampleRate;
+    const int64_t packetPeriodNs = (int64_t) (1e9 * spp / options.sampleRate);
+
+    // One burst, plus one packet held back by reordering and room for duplicates
+    const int maxPackets = 2 * options.burst + 1;
+    std::vector<char> packets (packetSize * (maxPackets + 1));
+    std::vector<iovec> iovecs (maxPackets);
+    std::vector<mmsghdr> msgs (maxPackets);
+    std::vector<char> held (packetSize);
+    bool haveHeld = false;
+
+    std::mt19937 random (options.seed + senderIndex);
+    std::uniform_real_distribution<double> chance (0.0, 1.0);
+    const Waveform waveform;
+
+    const int64_t start = monotonicNs();
+    const int64_t startRealtime = realtimeNs();
+    const int64_t end = options.seconds > 0 ? start + (int64_t) (options.seconds * 1e9) : INT64_MAX;
+    uint64_t sequence = 0;
+
+    while (running)
+    {
+        // Bursts are scheduled from the start time, so pacing errors never accumulate
+        const int64_t due = start + (int64_t) sequence * packetPeriodNs;
+        if (due >= end)
+            break;
+
+        if (monotonicNs() > due + packetPeriodNs * options.burst)
+            stats.behind++;
+        waitUntil (due);
+
+        int count = 0;
+        auto slot = [&] (int index) { return packets.data() + (size_t) index * packetSize; };
+
+        for (int b = 0; b < options.burst; b++, sequence++)
+        {
+            char* packet = slot (count);
+            const int64_t firstSample = (int64_t) sequence * spp;
+
+            if (options.header)
+                writePacketHeader (packet, sequence, (uint64_t) (startRealtime + (int64_t) (firstSample * 1e9 / options.sampleRate)),
+                                   options.channels, spp, PacketSampleFormat::INT16_LE);
+
+            waveform.render (reinterpret_cast<int16_t*> (packet + headerSize), firstSample, spp, options.channels, cyclesPerSample);
+
+            if (! options.header)
+            {
+                count++;
+                continue;
+            }
+
+            if (chance (random) < options.loss)
+            {
+                stats.dropped++;
+                continue;
+            }
+
+            if (! haveHeld && chance (random) < options.reorder)
+            {
+                // Sent right after the next packet
+                memcpy (held.data(), packet, packetSize);
+                haveHeld = true;
+                stats.reordered++;
+                continue;
+            }
+
+            count++;
+
+            if (chance (random) < options.duplicate)
+            {
+                memcpy (slot (count), packet, packetSize);
+                count++;
+                stats.duplicated++;
+            }
+
+            if (haveHeld)
+            {
+                memcpy (slot (count), held.data(), packetSize);
+                count++;
+                haveHeld = false;
+            }
+        }
+
+        for (int k = 0; k < count; k++)
+        {
+            iovecs[k] = { slot (k), packetSize };
+            msgs[k].msg_hdr = {};
+            msgs[k].msg_hdr.msg_iov = &iovecs[k];
+            msgs[k].msg_hdr.msg_iovlen = 1;
+        }
+
+        for (int sent = 0; sent < count;)
+        {
+            const int result = sendmmsg (sock, msgs.data() + sent, count - sent, 0);
+            if (result <= 0)
+            {
+                // e.g. ECONNREFUSED while nothing listens; the packets are lost
+                stats.errors += count - sent;
+                break;
+            }
+            sent += result;
+            stats.packets += result;
+            stats.frames += (int64_t) result * spp;
+        }
+    }
+
+    close (sock);
+}
+
+int main (int argc, char** argv)
+{
+    const Options options = parseOptions (argc, argv);
+
+    std::printf ("%s:%d  %s protocol, %d channels at %g Hz, %d frames/packet, bursts of %d, %d sender(s)\n",
+                 options.host.c_str(), options.port, options.header ? "Header" : "Raw", options.channels,
+                 options.sampleRate, options.samplesPerPacket, options.burst, options.senders);
+
+    std::vector<std::thread> senders;
+    for (int s = 0; s < options.senders; s++)
+        senders.emplace_back (runSender, std::cref (options), s);
+
+    // Report once per second until every sender is done
+    std::thread reporter ([&]
+    {
+        int64_t lastPackets = 0, lastFrames = 0;
+
+        while (running)
+        {
+            std::this_thread::sleep_for (std::chrono::seconds (1));
+
+            const int64_t packets = stats.packets, frames = stats.frames;
+            std::printf ("%10lld packets/s %12.3f Msamples/s   dropped %lld  reordered %lld  duplicated %lld  errors %lld  behind %lld\n",
+                         (long long) (packets - lastPackets), (frames - lastFrames) * (double) options.channels * 1e-6,
+                         (long long) stats.dropped, (long long) stats.reordered, (long long) stats.duplicated,
+                         (long long) stats.errors, (long long) stats.behind);
+            std::fflush (stdout);
+            lastPackets = packets;
+            lastFrames = frames;
+        }
+    });
+
+    for (auto& sender : senders)
+        sender.join();
+
+    running = false;
+    reporter.join();
+
+    return 0;
+}
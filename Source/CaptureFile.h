@@ -0,0 +1,97 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef CAPTUREFILE_H_DEFINED
+#define CAPTUREFILE_H_DEFINED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+    Layout of the packet capture segments written by PacketRecorder.
+
+    A segment is a CaptureFileHeader followed by records, each a
+    CaptureRecordHeader and the datagram exactly as it was received, padded
+    to a multiple of 8 bytes. Fields are in host byte order.
+
+    Segments are preallocated and filled through a memory mapping; when a
+    segment is closed, dataSize is filled in and the file is truncated to
+    its contents. A segment that was never closed (e.g. after a crash) still
+    reads correctly up to the first record with length 0.
+*/
+struct CaptureFileHeader
+{
+    char magic[8];          // CAPTURE_MAGIC
+    uint32_t version;       // CAPTURE_VERSION
+    uint32_t headerSize;    // bytes before the first record
+    uint64_t segmentIndex;  // 0 for the first segment of a capture
+    int64_t startTimeNs;    // CLOCK_REALTIME when the segment was opened
+    uint64_t dataSize;      // bytes of records; 0 until the segment is closed
+    uint64_t recordCount;   // 0 until the segment is closed
+    uint32_t protocol;      // PacketProtocol the datagrams were captured with
+    uint32_t reserved[3];
+};
+
+static_assert (sizeof (CaptureFileHeader) == 64, "CaptureFileHeader must stay 64 bytes");
+
+/** "OEUPCAP" and a terminating zero */
+constexpr char CAPTURE_MAGIC[8] = { 'O', 'E', 'U', 'P', 'C', 'A', 'P', '\0' };
+constexpr uint32_t CAPTURE_VERSION = 1;
+constexpr const char* CAPTURE_EXTENSION = ".oecap";
+
+/** CaptureRecordHeader::stream of a datagram whose sender had no stream */
+constexpr uint16_t CAPTURE_UNROUTED = 0xffff;
+
+struct CaptureRecordHeader
+{
+    int64_t receiveTimeNs;  // CLOCK_REALTIME kernel receive time
+    uint32_t length;        // datagram bytes that follow; 0 marks the end of the data
+    uint16_t receiver;      // index of the receiver thread that got it
+    uint16_t stream;        // sender stream it went to, CAPTURE_UNROUTED if none; 0 in older captures
+};
+
+static_assert (sizeof (CaptureRecordHeader) == 16, "CaptureRecordHeader must stay 16 bytes");
+
+/** Returns the bytes a record of a datagram of the given length occupies */
+inline size_t getCaptureRecordSize (size_t length)
+{
+    return sizeof (CaptureRecordHeader) + ((length + 7) & ~(size_t) 7);
+}
+
+/** Returns true if data starts with a capture segment header this code can read */
+inline bool isCaptureFileHeader (const void* data, size_t length)
+{
+    if (length < sizeof (CaptureFileHeader))
+        return false;
+
+    CaptureFileHeader header;
+    memcpy (&header, data, sizeof (header));
+
+    return memcmp (header.magic, CAPTURE_MAGIC, sizeof (CAPTURE_MAGIC)) == 0
+           && header.version == CAPTURE_VERSION
+           && header.headerSize >= sizeof (CaptureFileHeader)
+           && header.headerSize <= length;
+}
+
+#endif
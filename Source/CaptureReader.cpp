@@ -0,0 +1,364 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include "CaptureReader.h"
+
+#include "CaptureFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+
+// pcap file magic numbers, as read on the machine that wrote the file
+static constexpr uint32_t PCAP_MAGIC_US = 0xa1b2c3d4;
+static constexpr uint32_t PCAP_MAGIC_NS = 0xa1b23c4d;
+static constexpr size_t PCAP_FILE_HEADER_SIZE = 24;
+static constexpr size_t PCAP_RECORD_HEADER_SIZE = 16;
+
+// Link-layer types (LINKTYPE_* in the pcap specification)
+static constexpr uint32_t LINK_NULL = 0;
+static constexpr uint32_t LINK_ETHERNET = 1;
+static constexpr uint32_t LINK_RAW = 101;
+static constexpr uint32_t LINK_LINUX_SLL = 113;
+static constexpr uint32_t LINK_LINUX_SLL2 = 276;
+
+static uint16_t readBigEndian16 (const unsigned char* at)
+{
+    return (uint16_t) ((at[0] << 8) | at[1]);
+}
+
+// ------------------------------------------------------------
+
+CaptureReader::CaptureReader()
+{
+}
+
+CaptureReader::~CaptureReader()
+{
+    close();
+}
+
+bool CaptureReader::open (const std::string& path, int port_)
+{
+    close();
+    port = port_;
+
+    if (! map (path))
+        return false;
+
+    uint32_t magic = 0;
+    if (size >= sizeof (magic))
+        memcpy (&magic, data, sizeof (magic));
+
+    if (isCaptureFileHeader (data, size))
+    {
+        CaptureFileHeader header;
+        memcpy (&header, data, sizeof (header));
+
+        format = FORMAT_CAPTURE;
+        protocol = (int) header.protocol;
+        segmentIndex = header.segmentIndex;
+        offset = header.headerSize;
+        end = header.dataSize > 0 ? std::min (size, (size_t) (header.headerSize + header.dataSize)) : size;
+
+        // Segments are named <prefix>_NNNN<extension>; anything else is read on its own
+        const std::string extension = CAPTURE_EXTENSION;
+        const size_t numberLength = 5;
+
+        if (path.size() > extension.size() + numberLength
+            && path.compare (path.size() - extension.size(), extension.size(), extension) == 0
+            && path[path.size() - extension.size() - numberLength] == '_')
+            segmentPrefix = path.substr (0, path.size() - extension.size() - numberLength);
+
+        return true;
+    }
+
+    if (size >= PCAP_FILE_HEADER_SIZE
+        && (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS
+            || magic == __builtin_bswap32 (PCAP_MAGIC_US) || magic == __builtin_bswap32 (PCAP_MAGIC_NS)))
+    {
+        format = FORMAT_PCAP;
+        swapped = magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS;
+        nanoseconds = magic == PCAP_MAGIC_NS || magic == __builtin_bswap32 (PCAP_MAGIC_NS);
+        linkType = read32 (data + 20) & 0x0fffffff; // upper bits carry FCS information
+        offset = PCAP_FILE_HEADER_SIZE;
+        end = size;
+
+        return true;
+    }
+
+    close();
+    return false;
+}
+
+void CaptureReader::close()
+{
+    unmap();
+    format = FORMAT_NONE;
+    protocol = -1;
+    segmentPrefix.clear();
+}
+
+bool CaptureReader::next (Datagram& datagram)
+{
+    if (format == FORMAT_CAPTURE)
+        return nextCaptureRecord (datagram);
+
+    if (format == FORMAT_PCAP)
+        return nextPcapRecord (datagram);
+
+    return false;
+}
+
+bool CaptureReader::map (const std::string& path)
+{
+    const int fd = ::open (path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    struct stat info;
+    if (fstat (fd, &info) == -1 || info.st_size == 0)
+    {
+        ::close (fd);
+        return false;
+    }
+
+    void* address = mmap (nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close (fd); // the mapping keeps the file open
+
+    if (address == MAP_FAILED)
+        return false;
+
+    data = static_cast<const char*> (address);
+    size = (size_t) info.st_size;
+    offset = 0;
+    end = 0;
+    madvise (const_cast<char*> (data), size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    return true;
+}
+
+void CaptureReader::unmap()
+{
+    if (data != nullptr)
+        munmap (const_cast<char*> (data), size);
+
+    data = nullptr;
+    size = 0;
+    offset = 0;
+    end = 0;
+}
+
+bool CaptureReader::nextCaptureRecord (Datagram& datagram)
+{
+    while (true)
+    {
+        if (offset + sizeof (CaptureRecordHeader) <= end)
+        {
+            CaptureRecordHeader record;
+            memcpy (&record, data + offset, sizeof (record));
+
+            // A length of 0 is the unwritten part of a segment that was never closed
+            if (record.length > 0 && offset + sizeof (record) + record.length <= end)
+            {
+                datagram.data = data + offset + sizeof (record);
+                datagram.length = record.length;
+                datagram.receiveTimeNs = record.receiveTimeNs;
+                datagram.receiver = record.receiver;
+                datagram.senderStream = record.stream == CAPTURE_UNROUTED ? SenderStreams::NO_STREAM : record.stream;
+                datagram.hasSender = false;
+
+                offset += getCaptureRecordSize (record.length);
+                return true;
+            }
+        }
+
+        if (! openNextSegment())
+            return false;
+    }
+}
+
+bool CaptureReader::openNextSegment()
+{
+    if (segmentPrefix.empty())
+        return false;
+
+    char number[16];
+    snprintf (number, sizeof (number), "_%04llu", (unsigned long long) (segmentIndex + 1));
+    const std::string path = segmentPrefix + number + CAPTURE_EXTENSION;
+
+    unmap();
+
+    if (! map (path) || ! isCaptureFileHeader (data, size))
+        return false;
+
+    CaptureFileHeader header;
+    memcpy (&header, data, sizeof (header));
+
+    segmentIndex = header.segmentIndex;
+    offset = header.headerSize;
+    end = header.dataSize > 0 ? std::min (size, (size_t) (header.headerSize + header.dataSize)) : size;
+
+    return true;
+}
+
+bool CaptureReader::nextPcapRecord (Datagram& datagram)
+{
+    while (offset + PCAP_RECORD_HEADER_SIZE <= end)
+    {
+        const char* record = data + offset;
+        const uint32_t seconds = read32 (record);
+        const uint32_t fraction = read32 (record + 4);
+        const size_t captured = read32 (record + 8);
+
+        if (offset + PCAP_RECORD_HEADER_SIZE + captured > end)
+            return false; // truncated file
+
+        const unsigned char* frame = reinterpret_cast<const unsigned char*> (record + PCAP_RECORD_HEADER_SIZE);
+        offset += PCAP_RECORD_HEADER_SIZE + captured;
+
+        if (parseFrame (frame, captured, datagram))
+        {
+            datagram.receiveTimeNs = seconds * 1000000000LL + (nanoseconds ? fraction : fraction * 1000LL);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CaptureReader::parseFrame (const unsigned char* frame, size_t length, Datagram& datagram) const
+{
+    // Strip the link layer down to the IP packet
+    size_t ip = 0;
+    uint16_t etherType = 0;
+
+    switch (linkType)
+    {
+        case LINK_NULL:
+            ip = 4; // address family in the capturing machine's byte order; the IP version tells
+            break;
+
+        case LINK_ETHERNET:
+            ip = 14;
+            if (length < ip)
+                return false;
+            etherType = readBigEndian16 (frame + 12);
+
+            // 802.1Q / 802.1ad tags
+            while ((etherType == 0x8100 || etherType == 0x88a8) && length >= ip + 4)
+            {
+                etherType = readBigEndian16 (frame + ip + 2);
+                ip += 4;
+            }
+
+            if (etherType != 0x0800 && etherType != 0x86dd)
+                return false;
+            break;
+
+        case LINK_RAW:
+        case 12: // LINKTYPE_RAW on some BSDs
+        case 14:
+            ip = 0;
+            break;
+
+        case LINK_LINUX_SLL:
+            ip = 16;
+            break;
+
+        case LINK_LINUX_SLL2:
+            ip = 20;
+            break;
+
+        default:
+            return false;
+    }
+
+    if (length < ip + 1)
+        return false;
+
+    const unsigned char* packet = frame + ip;
+    const size_t packetLength = length - ip;
+    const unsigned char* sourceAddress;
+    size_t addressLength;
+    size_t udp;
+
+    if ((packet[0] >> 4) == 4)
+    {
+        const size_t headerLength = (packet[0] & 0x0f) * 4;
+        if (packetLength < headerLength + 8 || headerLength < 20 || packet[9] != 17)
+            return false;
+
+        // Fragments cannot be replayed without reassembly
+        if ((readBigEndian16 (packet + 6) & 0x3fff) != 0)
+            return false;
+
+        sourceAddress = packet + 12;
+        addressLength = 4;
+        udp = headerLength;
+    }
+    else if ((packet[0] >> 4) == 6)
+    {
+        // UDP directly after the fixed header; extension headers are not followed
+        if (packetLength < 40 + 8 || packet[6] != 17)
+            return false;
+
+        sourceAddress = packet + 8;
+        addressLength = 16;
+        udp = 40;
+    }
+    else
+    {
+        return false;
+    }
+
+    if (readBigEndian16 (packet + udp + 2) != port)
+        return false;
+
+    const size_t udpLength = readBigEndian16 (packet + udp + 4);
+    if (udpLength < 8)
+        return false;
+
+    // Datagrams cut short by the capture's snap length are replayed as far as they were captured
+    datagram.data = reinterpret_cast<const char*> (packet + udp + 8);
+    datagram.length = std::min (udpLength, packetLength - udp) - 8;
+    datagram.sender = SenderAddress::fromBytes (sourceAddress, addressLength, readBigEndian16 (packet + udp));
+    datagram.hasSender = true;
+    datagram.senderStream = SenderStreams::NO_STREAM;
+
+    // Each sender keeps to one receiver
+    datagram.receiver = datagram.sender.hash();
+
+    return datagram.length > 0;
+}
+
+uint32_t CaptureReader::read32 (const char* at) const
+{
+    uint32_t value;
+    memcpy (&value, at, sizeof (value));
+    return swapped ? __builtin_bswap32 (value) : value;
+}
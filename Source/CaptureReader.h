@@ -0,0 +1,113 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef CAPTUREREADER_H_DEFINED
+#define CAPTUREREADER_H_DEFINED
+
+#include "SenderStreams.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+    Reads the datagrams of a packet capture in order, straight from a memory
+    mapping of the file.
+
+    Two formats are understood: capture segments written by PacketRecorder
+    (following segments of the same capture are read on automatically), and
+    classic pcap files, from which the UDP datagrams to one port are taken
+    over Ethernet, Linux cooked, loopback or raw IP links. Fragmented IP
+    datagrams are skipped.
+*/
+class CaptureReader
+{
+public:
+    /** One datagram, valid until the next call to next() or close() */
+    struct Datagram
+    {
+        const char* data;
+        size_t length;
+        int64_t receiveTimeNs; // CLOCK_REALTIME when it was captured
+        uint32_t receiver;     // receiver that got it, or a hash of the sender's address
+        int senderStream;      // stream it was recorded in, SenderStreams::NO_STREAM if unrouted
+        bool hasSender;        // sender is known (pcap); capture segments record senderStream instead
+        SenderAddress sender;
+    };
+
+    CaptureReader();
+    ~CaptureReader();
+
+    /** Maps the file; for pcap files, only datagrams to port are returned. Returns false if it cannot be read. */
+    bool open (const std::string& path, int port);
+
+    void close();
+
+    /** Moves to the next datagram; returns false at the end of the capture */
+    bool next (Datagram& datagram);
+
+    /** PacketProtocol the capture was recorded with, or -1 if the file does not say (pcap) */
+    int getProtocol() const { return protocol; }
+
+private:
+    enum Format
+    {
+        FORMAT_NONE,
+        FORMAT_CAPTURE,
+        FORMAT_PCAP
+    };
+
+    bool map (const std::string& path);
+    void unmap();
+
+    bool nextCaptureRecord (Datagram& datagram);
+    bool nextPcapRecord (Datagram& datagram);
+
+    /** Finds the UDP datagram in a captured frame, if it is one to port */
+    bool parseFrame (const unsigned char* frame, size_t length, Datagram& datagram) const;
+
+    /** Opens the segment after the current one, if the capture has one */
+    bool openNextSegment();
+
+    uint32_t read32 (const char* at) const;
+
+    Format format = FORMAT_NONE;
+    const char* data = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+    size_t end = 0; // offset where the records stop
+
+    int protocol = -1;
+    int port = 0;
+
+    // Capture segments
+    std::string segmentPrefix; // path up to the segment number, empty if not numbered
+    uint64_t segmentIndex = 0;
+
+    // pcap
+    bool swapped = false;      // written on a machine of the other byte order
+    bool nanoseconds = false;  // timestamps carry ns rather than us
+    uint32_t linkType = 0;
+};
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include "ChannelCalibration.h"
+
+#include "SampleFrame.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+/** Splits a line at spaces, tabs and commas, up to a '#' */
+static std::vector<std::string> splitFields (const std::string& line)
+{
+    std::vector<std::string> fields;
+    std::string field;
+
+    for (char c : line)
+    {
+        if (c == '#')
+            break;
+
+        if (c == ' ' || c == '\t' || c == ',' || c == '\r')
+        {
+            if (! field.empty())
+                fields.push_back (field);
+            field.clear();
+        }
+        else
+        {
+            field += c;
+        }
+    }
+
+    if (! field.empty())
+        fields.push_back (field);
+
+    return fields;
+}
+
+/** Parses the whole of text as a finite float */
+static bool parseFloat (const std::string& text, float& value)
+{
+    char* end = nullptr;
+    value = std::strtof (text.c_str(), &end);
+
+    return end != text.c_str() && *end == '\0' && std::isfinite (value);
+}
+
+// ------------------------------------------------------------
+
+bool CalibrationTable::load (const std::string& path, std::string& error)
+{
+    std::ifstream file (path);
+    if (! file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::stringstream text;
+    text << file.rdbuf();
+
+    return parse (text.str(), error);
+}
+
+bool CalibrationTable::parse (const std::string& text, std::string& error)
+{
+    CalibrationTable table;
+    std::istringstream lines (text);
+    std::string line;
+    int lineNumber = 0;
+
+    while (std::getline (lines, line))
+    {
+        lineNumber++;
+
+        if (splitFields (line).empty())
+            continue;
+
+        int channel;
+        ChannelCalibration calibration;
+
+        if (! parseLine (line, channel, calibration, error))
+        {
+            error = "line " + std::to_string (lineNumber) + ": " + error;
+            return false;
+        }
+
+        table.set (channel, calibration);
+    }
+
+    *this = std::move (table);
+    return true;
+}
+
+bool CalibrationTable::parseLine (const std::string& line, int& channel, ChannelCalibration& calibration, std::string& error)
+{
+    const std::vector<std::string> fields = splitFields (line);
+
+    if (fields.size() < 2 || fields.size() > 4)
+    {
+        error = "expected: channel gain [offset] [units]";
+        return false;
+    }
+
+    char* end = nullptr;
+    const long number = std::strtol (fields[0].c_str(), &end, 10);
+
+    if (*end != '\0' || number < 1 || number > MAX_DATA_CHANNELS)
+    {
+        error = "channel must be 1 to " + std::to_string (MAX_DATA_CHANNELS);
+        return false;
+    }
+
+    calibration = ChannelCalibration();
+
+    if (! parseFloat (fields[1], calibration.gain) || calibration.gain == 0)
+    {
+        error = "gain must be a non-zero number";
+        return false;
+    }
+
+    if (fields.size() > 2 && ! parseFloat (fields[2], calibration.offset))
+    {
+        // Offset left out, units given
+        if (fields.size() > 3)
+        {
+            error = "offset must be a number";
+            return false;
+        }
+
+        calibration.units = fields[2];
+    }
+    else if (fields.size() > 3)
+    {
+        calibration.units = fields[3];
+    }
+
+    channel = (int) number - 1;
+    return true;
+}
+
+void CalibrationTable::set (int channel, const ChannelCalibration& calibration)
+{
+    if (channel < 0 || channel >= MAX_DATA_CHANNELS)
+        return;
+
+    if ((int) channels.size() <= channel)
+    {
+        channels.resize (channel + 1);
+        calibrated.resize (channel + 1, false);
+    }
+
+    channels[channel] = calibration;
+    calibrated[channel] = true;
+}
+
+void CalibrationTable::clear()
+{
+    channels.clear();
+    calibrated.clear();
+}
+
+const ChannelCalibration* CalibrationTable::find (int channel) const
+{
+    if (channel < 0 || channel >= (int) channels.size() || ! calibrated[channel])
+        return nullptr;
+
+    return &channels[channel];
+}
+
+int CalibrationTable::size() const
+{
+    int count = 0;
+
+    for (bool c : calibrated)
+        count += c ? 1 : 0;
+
+    return count;
+}
@@ -0,0 +1,82 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef CHANNELCALIBRATION_H_DEFINED
+#define CHANNELCALIBRATION_H_DEFINED
+
+#include <string>
+#include <vector>
+
+/** Converts one channel's decoded samples to physical units: value = sample * gain + offset */
+struct ChannelCalibration
+{
+    float gain = 1;
+    float offset = 0;          // in units
+    std::string units = "uV";
+};
+
+/**
+    Calibrations for some or all channels, read from a text file or set one
+    channel at a time. Channels without one keep the plugin's Data Scale.
+
+    The text format has one channel per line, fields separated by spaces,
+    tabs or commas:
+
+        # channel  gain   offset  units
+        1          0.195  0       uV
+        2          0.195  -12.5   uV
+        33         0.001          mV
+
+    Channels are numbered from 1, as in the channel names. Offset and units
+    may be left out (0 and uV). Anything after a '#' is a comment.
+*/
+class CalibrationTable
+{
+public:
+    /** Replaces the table with the contents of a file; on failure the table is unchanged and error says why */
+    bool load (const std::string& path, std::string& error);
+
+    /** Replaces the table with calibrations in the text format above; same failure behaviour as load() */
+    bool parse (const std::string& text, std::string& error);
+
+    /** Parses a single line of the text format into channel (0-based) and calibration; blank lines are an error */
+    static bool parseLine (const std::string& line, int& channel, ChannelCalibration& calibration, std::string& error);
+
+    /** Sets the calibration of one channel (0-based) */
+    void set (int channel, const ChannelCalibration& calibration);
+
+    /** Removes every calibration */
+    void clear();
+
+    /** Returns the calibration of a channel (0-based), or nullptr if it has none */
+    const ChannelCalibration* find (int channel) const;
+
+    /** Number of calibrated channels */
+    int size() const;
+
+private:
+    std::vector<ChannelCalibration> channels; // indexed by channel
+    std::vector<bool> calibrated;             // whether channels[i] was set
+};
+
+#endif
@@ -24,296 +24,30 @@
 #include "DataThreadPlugin.h"
 #include "DataThreadPluginEditor.h"
 
-// Server Stuff
-#include <arpa/inet.h>
-#include <errno.h>
-#include <fcntl.h>
-#include <netinet/in.h>
-#include <signal.h>
-#include <stdio.h>
-#include <string.h>
-#include <sys/epoll.h>
-#include <sys/signalfd.h>
-#include <sys/socket.h>
-#include <unistd.h>
+const double SAMPLE_RATE = 30000.0;
 
-#include <array>
-#include <iostream>
-#include <thread>
-#include <chrono>
-
-const int MAX_DATA_CHANNELS = 128;
-const int METRICS_CHANNELS = 2;
-const int MAX_SAMPLES_PER_CHANNEL = 1024;
-
-int64 totalSamples = 0;
-
-// Datapoints
-float data_points[MAX_DATA_CHANNELS * MAX_SAMPLES_PER_CHANNEL];
-int64 sample_numbers[MAX_SAMPLES_PER_CHANNEL]; 
-uint64 event_codes[MAX_SAMPLES_PER_CHANNEL];
-double timestamps[MAX_SAMPLES_PER_CHANNEL];
-
-
-
-DataBuffer* dataBuffer;
-
-// Metrics
-float metric_data_points[METRICS_CHANNELS * MAX_SAMPLES_PER_CHANNEL];
-int64 metric_sample_numbers[MAX_SAMPLES_PER_CHANNEL]; 
-uint64 metric_event_codes[MAX_SAMPLES_PER_CHANNEL];
-double metric_timestamps[MAX_SAMPLES_PER_CHANNEL];
-
-
-
-DataBuffer* metricsDataBuffer;
-
-// UDP variables
-int port = 8080;
-int data_channels = 5;
-int gui_refresh_min = 300;
-float data_scale = 25;
-
-std::atomic<int> packet_queue_count(0);
-std::atomic<float> udp_values[MAX_SAMPLES_PER_CHANNEL * MAX_DATA_CHANNELS];
-std::atomic<int> server_running(0);
-std::atomic<int> server_closed(0);
-std::atomic<int> point_per_packet(1);
-
-typedef std::chrono::high_resolution_clock::time_point tp;
-tp get_time()
-{
-	return std::chrono::high_resolution_clock::now();
-}
-
-
-static int set_nonblocking(int fd) {
-    int flags = fcntl(fd, F_GETFL, 0);
-    if (flags == -1) return -1;
-    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
-}
-
-int udp_thread_function() {
-    LOGD("Attempting to listen on port ", port);
-    // Create UDP socket (IPv4)
-	
-	if (port == -1)
-		return 1;
-	
-	std::array<char, 65536> buf{}; // max UDP payload size (practical)
-
-	constexpr int MAX_EVENTS = 64;
-	std::array<epoll_event, MAX_EVENTS> events;
-
-	// UDP stuff idk
-	int sock; // UDP socket
-	int sfd;
-	int ep;
-	
-    sock = ::socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock == -1) {
-        LOGD("socket");
-        return 1;
-    }
-
-    if (set_nonblocking(sock) == -1) {
-        LOGD("fcntl(O_NONBLOCK)");
-        return 1;
-    }
-
-	int yes = 1;
-	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
-	setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)); // optional, Linux-specific
-
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(port);
-    if (bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
-        perror("bind");
-        return 1;
-    }
-
-    // Create signalfd so we can shut down cleanly via epoll (Ctrl+C)
-    sigset_t mask;
-    sigemptyset(&mask);
-    sigaddset(&mask, SIGINT);
-    sigaddset(&mask, SIGTERM);
-    // Block signals from default handling
-    if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
-        LOGD("pthread_sigmask");
-        return 1;
-    }
-    sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
-    if (sfd == -1) {
-        LOGD("signalfd");
-        return 1;
-    }
-
-    // epoll setup
-    ep = epoll_create1(EPOLL_CLOEXEC);
-    if (ep == -1) {
-        LOGD("epoll_create1");
-        return 1;
-    }
-
-    epoll_event ev{};
-    ev.events = EPOLLIN | EPOLLET;   // edge-triggered, read events
-    ev.data.fd = sock;
-    if (epoll_ctl(ep, EPOLL_CTL_ADD, sock, &ev) == -1) {
-        LOGD("epoll_ctl(ADD sock)");
-        return 1;
-    }
-
-    epoll_event sig_ev{};
-    sig_ev.events = EPOLLIN;
-    sig_ev.data.fd = sfd;
-    if (epoll_ctl(ep, EPOLL_CTL_ADD, sfd, &sig_ev) == -1) {
-        LOGD("epoll_ctl(ADD signalfd)");
-        return 1;
-    }
-
-
-    LOGD("UDP server listening on port ", port);
-	server_running = true;
-
-	
-
-	while (server_running) {
-		int n = epoll_wait(ep, events.data(), MAX_EVENTS, -1);
-		if (n == -1) {
-			if (errno == EINTR) continue;
-			LOGD("epoll_wait");
-			continue;
-		}
-
-		for (int i = 0; i < n; ++i) {
-
-			int fd = events[i].data.fd;
-
-			if (fd == sfd) {
-				// Handle shutdown signal
-				signalfd_siginfo si;
-				ssize_t r = read(sfd, &si, sizeof(si));
-				(void)r;
-				server_running = false;
-				break;
-			}
-
-			if (fd == sock) {
-				// Drain all readable datagrams (edge-triggered!)
-				while (server_running) {
-					
-
-					sockaddr_in src{};
-					socklen_t srclen = sizeof(src);
-
-					ssize_t r = recvfrom(sock, buf.data(), buf.size(), 0,
-										 reinterpret_cast<sockaddr*>(&src), &srclen);
-					if (r > 0) {
-						// Example "processing": print and echo back
-						char ip[INET_ADDRSTRLEN];
-						inet_ntop(AF_INET, &src.sin_addr, ip, sizeof(ip));
-						uint16_t sport = ntohs(src.sin_port);
-
-						short *data = (short*) buf.data();
-
-						if (MAX_SAMPLES_PER_CHANNEL <= packet_queue_count)
-						{
-							LOGD("Forced to drop packet");
-							break;
-						}
-
-						for (int j = 0; j < data_channels; j++)
-						{
-							udp_values[j*MAX_SAMPLES_PER_CHANNEL + packet_queue_count] = data[j];
-						}
-
-						//LOGD("1: ", data[3], ", 2: ", data[4]);
-
-						packet_queue_count++;
-						// LOGD("Data", *((float*) buf.data()));
-
-					} else if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-						// No more packets
-						break;
-					} else if (r == 0) {
-						// UDP doesn't really give 0 here, but handle defensively
-						break;
-					} else {
-						LOGD("recvfrom");
-						break;
-					}
-				}
-			}
-		}
-
-
-		std::this_thread::sleep_for(std::chrono::milliseconds(10));
-	}
-
-
-	// Closing the socket
-	if (sock != -1) {
-        epoll_ctl(ep, EPOLL_CTL_DEL, sock, nullptr); // remove from epoll
-        close(sock);
-        sock = -1;
-        std::cout << "Closed UDP socket\n";
-    }
-
-    if (sfd != -1) {
-        epoll_ctl(ep, EPOLL_CTL_DEL, sfd, nullptr); // remove signal fd
-        close(sfd);
-        sfd = -1;
-        std::cout << "Closed signal fd\n";
-    }
-
-    if (ep != -1) {
-        close(ep);
-        ep = -1;
-        std::cout << "Closed epoll instance\n";
-    }
-
-	server_closed = true;
-	LOGD("Closed Plugin");
-
-	return 0;
-    
-}
-
-void close_udp_thread()
+/** Logs how much a receiver counter has grown since it was last reported */
+static void report_counter(int64 value, int64& reported, const char* message)
 {
-	// Check if existing server is running
-	if (server_running)
+	if (value != reported)
 	{
-		// Close existing thread
-		server_closed = false;
-		server_running = false; // Actually closes thread
-
-		LOGD("Attempt to close server");
-
-		// Wait till server has closed
-		while (!server_closed)
-			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		LOGD(message, value - reported);
+		reported = value;
 	}
 }
 
-void restart_thread()
-{
-	close_udp_thread();	
-
-	server_closed = false;
-	std::thread t(udp_thread_function);
-	t.detach();
-}
-
 struct PluginSettingsObject
 {
     // Store settings for the plugin here
 };
 
-DataThreadPlugin::DataThreadPlugin (SourceNode* sn) : DataThread (sn)
+DataThreadPlugin::DataThreadPlugin (SourceNode* sn) : DataThread (sn),
+	channelGains(MAX_DATA_CHANNELS, dataScale),
+	channelOffsets(MAX_DATA_CHANNELS, 0.0f),
+	eventCodes(MAX_SAMPLES_PER_CHANNEL)
 {
+	receiverSettings.sampleRate = SAMPLE_RATE;
+	receiver.setMaxBlockSize(MAX_SAMPLES_PER_CHANNEL); // what updateBuffer() reads per call
 }
 
 DataThreadPlugin::~DataThreadPlugin()
@@ -340,50 +74,96 @@ void DataThreadPlugin::updateSettings (OwnedArray<ContinuousChannel>* continuous
 
 	LOGD("Update Settings");
 
-	DataStream::Settings packet_stream_settings
+	// One DataStream per sender stream, each with its own buffer and the same channels
+	const int num_streams = std::clamp(receiverSettings.streams, 1, SenderStreams::MAX_STREAMS);
+
+	dataPoints.resize((size_t) num_streams * MAX_DATA_CHANNELS * MAX_SAMPLES_PER_CHANNEL);
+	sampleNumbers.resize((size_t) num_streams * MAX_SAMPLES_PER_CHANNEL);
+	timestamps.resize((size_t) num_streams * MAX_SAMPLES_PER_CHANNEL);
+	streamBlocks.resize(num_streams);
+	dataBuffers.clear();
+
+	for (int i = 0; i < receiverSettings.channels; i++)
 	{
-	   "UDP Packet Stream", // stream name
-	   "Pulls data from UDP packets",   // stream description
-	   "identifier",    // stream identifier
-	   30000.0          // stream sample rate
-	};
+	   // One count of a calibrated channel is its gain; the others use Data Scale
+	   const ChannelCalibration* calibration = channelCalibration.find(i);
+	   channelGains[i] = calibration ? calibration->gain : dataScale;
+	   channelOffsets[i] = calibration ? calibration->offset : 0.0f;
+	}
+
+	for (int s = 0; s < num_streams; s++)
+	{
+	   DataStream::Settings packet_stream_settings
+	   {
+	      num_streams == 1 ? String("UDP Packet Stream") : "UDP Packet Stream " + String(s + 1), // stream name
+	      "Pulls data from UDP packets",   // stream description
+	      "identifier",    // stream identifier
+	      SAMPLE_RATE      // stream sample rate
+	   };
+
+	   DataStream* packet_stream = new DataStream(packet_stream_settings);
+	   sourceStreams->add(packet_stream); // add pointer to owned array
+
+	   // Only the configured channels travel down the signal chain
+	   sourceBuffers.add(new DataBuffer(receiverSettings.channels, 48000));
+	   dataBuffers.push_back(sourceBuffers.getLast());
+
+	   UdpReceiver::StreamBlock& block = streamBlocks[s];
+	   block.dest = dataPoints.data() + (size_t) s * MAX_DATA_CHANNELS * MAX_SAMPLES_PER_CHANNEL;
+	   block.sampleNumbers = sampleNumbers.data() + (size_t) s * MAX_SAMPLES_PER_CHANNEL;
+	   block.timestamps = timestamps.data() + (size_t) s * MAX_SAMPLES_PER_CHANNEL;
+	   block.gains = channelGains.data();
+	   block.offsets = channelOffsets.data();
+	   block.numFrames = 0;
+
+	   // packet channels
+	   for (int i = 0; i < receiverSettings.channels; i++)
+	   {
+	      const ChannelCalibration* calibration = channelCalibration.find(i);
+
+	      ContinuousChannel::Settings settings{
+	                             ContinuousChannel::Type::ELECTRODE, // channel type
+	                             "CH" + String(i+1), // channel name
+	                             "description",      // channel description
+	                             "identifier",       // channel identifier
+	                             channelGains[i],    // channel bitvolts scaling
+	                             packet_stream              // associated data stream
+	                     };
+
+	      ContinuousChannel* channel = new ContinuousChannel(settings);
+	      if (calibration)
+		      channel->setUnits(calibration->units);
+
+	      continuousChannels->add(channel);
+	   }
+
+	   // Not sure if this is needed
+	   EventChannel::Settings settings2{
+	                     EventChannel::Type::TTL, // channel type (must be TTL)
+	                     "Device Event Channel",  // channel name
+	                     "description",           // channel description
+	                     "identifier",            // channel identifier
+	                     packet_stream,                  // associated data stream
+	                     8                        // maximum number of TTL lines
+	             };
+
+	   eventChannels->add(new EventChannel(settings2));
+	}
 
 	DataStream::Settings packet_rate_stream_settings
 	{
 	   "UDP Packet Rate", // stream name
 	   "Rate at which packets are being transfered",   // stream description
 	   "identifier",    // stream identifier
-	   30000.0          // stream sample rate
+	   SAMPLE_RATE      // stream sample rate
 	};
 
-	DataStream* packet_stream = new DataStream(packet_stream_settings);
 	DataStream* packet_rate_stream = new DataStream(packet_rate_stream_settings);
-
-	sourceStreams->add(packet_stream); // add pointer to owned array
 	sourceStreams->add(packet_rate_stream); // add pointer to owned array
 
-	// create a data buffer and add it to the sourceBuffer array
-	sourceBuffers.add(new DataBuffer(MAX_DATA_CHANNELS, 48000));
-	dataBuffer = sourceBuffers.getLast();
-
 	sourceBuffers.add(new DataBuffer(METRICS_CHANNELS, 48000));
 	metricsDataBuffer = sourceBuffers.getLast();
 
-	// packet channels
-	for (int i = 0; i < MAX_DATA_CHANNELS; i++)
-	{
-	   ContinuousChannel::Settings settings{
-	                          ContinuousChannel::Type::ELECTRODE, // channel type
-	                          "CH" + String(i+1), // channel name
-	                          "description",      // channel description
-	                          "identifier",       // channel identifier
-	                          0.195,              // channel bitvolts scaling
-	                          packet_stream              // associated data stream
-	                  };
-
-	   continuousChannels->add(new ContinuousChannel(settings));
-	}
-
 	// setting channels
 	ContinuousChannel::Settings settings{
 						  ContinuousChannel::Type::ELECTRODE, // channel type
@@ -396,94 +176,148 @@ void DataThreadPlugin::updateSettings (OwnedArray<ContinuousChannel>* continuous
 
 	continuousChannels->add(new ContinuousChannel(settings));
 
-	// Not sure if this is needed
-	EventChannel::Settings settings2{
-	                  EventChannel::Type::TTL, // channel type (must be TTL)
-	                  "Device Event Channel",  // channel name
-	                  "description",           // channel description
-	                  "identifier",            // channel identifier
-	                  packet_stream,                  // associated data stream
-	                  8                        // maximum number of TTL lines
-	          };
-
-	eventChannels->add(new EventChannel(settings2));
+	// packet accounting, cumulative since acquisition started
+	const char* counter_names[] = { "Kernel Drops", "Lost Packets", "Late Packets", "Duplicate Packets", "Unrouted Packets" };
+	for (const char* name : counter_names)
+	{
+		ContinuousChannel::Settings counter_settings{
+							  ContinuousChannel::Type::ELECTRODE, // channel type
+							  name, // channel name
+							  "description",      // channel description
+							  "identifier",       // channel identifier
+							  1.0,                // channel bitvolts scaling
+							  packet_rate_stream              // associated data stream
+					  };
+
+		continuousChannels->add(new ContinuousChannel(counter_settings));
+	}
 }
 
 bool DataThreadPlugin::startAcquisition()
 {
-	startThread();
+	receiver.stop();
+	reported = UdpReceiver::Counters();
+	reportedCaptureDrops = 0;
+	acquisitionScheduled = false;
+	lastBufferUpdate = std::chrono::steady_clock::now();
 
-	for (int i = 0; i < MAX_SAMPLES_PER_CHANNEL * MAX_DATA_CHANNELS; i++)
-		udp_values[i] = 0;
+	// Receivers are stopped, so the recorder can be swapped in or out
+	recorder.stop();
+	receiver.setRecorder(nullptr);
 
-	restart_thread(); // Start UDP thread
+	if (captureEnabled && receiverSettings.source == SOURCE_NETWORK)
+	{
+		File capture_directory = capturePath.isEmpty() ? CoreServices::getRecordingParentDirectory() : File(capturePath);
+		capture_directory.createDirectory();
+
+		if (recorder.start(capture_directory.getFullPathName().toStdString(), (size_t) captureSegmentMb << 20,
+						   receiverSettings.receivers, receiverSettings.protocol))
+		{
+			receiver.setRecorder(&recorder);
+			LOGC("Capturing packets to ", capture_directory.getFullPathName());
+		}
+		else
+		{
+			LOGE("Cannot create capture files in ", capture_directory.getFullPathName(), ", acquiring without capture");
+		}
+	}
+
+	// Queues and shards are set up before the acquisition thread can read them
+	receiver.start(receiverSettings); // Start UDP threads
+
+	startThread();
 	return true;
 }
 
-
-tp last_buffer_update;
-float packet_rate = 0;
 bool DataThreadPlugin::updateBuffer()
 {
-
-	int packet_count = packet_queue_count; // prevent multithreading weirdness
-	if (packet_count < gui_refresh_min)
+	if (! acquisitionScheduled)
 	{
+		// First call on this acquisition's thread
+		const ThreadScheduling achieved = applyThreadScheduling(acquisitionRequest);
+		acquisitionScheduling = achieved;
+		acquisitionScheduled = true;
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		return true;
+		if (achieved.cpu != acquisitionRequest.cpu)
+			LOGC("Acquisition thread cannot be pinned to core ", acquisitionRequest.cpu, ", it may run on any core");
+
+		if (achieved.priority < acquisitionRequest.priority)
+			LOGC("Acquisition thread is not permitted SCHED_FIFO (needs CAP_SYS_NICE or an rtprio limit), running at normal priority");
 	}
 
-	for (int i = 0; i < packet_count; i++)
+	int available = receiver.getQueuedFrames();
+	if (available == 0 || available < receiver.getFlushThreshold())
 	{
-		for (int j = 0; j < data_channels; j++)
-		{
-			data_points[j * packet_count + i] = udp_values[j * MAX_SAMPLES_PER_CHANNEL + i] * data_scale;
-		}
+		// Sleep until the receivers have a full block or a flush deadline passes;
+		// the timeout only bounds how long a stop request can go unnoticed
+		if (! receiver.waitForFrames(100))
+			return true;
 
+		if (receiver.getQueuedFrames() == 0)
+			return true;
+	}
 
-		
+	// Anything beyond one block stays queued for the next call
+	const int packet_count = receiver.readBlock(streamBlocks.data(), MAX_SAMPLES_PER_CHANNEL);
 
-		sample_numbers[i] = totalSamples++;
-	}
+	if (packet_count == 0)
+		return true;
 
-	// Filling other channels with 0s
-	for (int i = data_channels*packet_count; i < MAX_DATA_CHANNELS*packet_count; i++)
-	{
+	const UdpReceiver::Counters counters = receiver.getCounters();
 
-		data_points[i] = 0;
-	}
+	report_counter(counters.kernelDrops, reported.kernelDrops, "Socket buffer full, packets dropped by the kernel: ");
+	report_counter(counters.droppedFrames, reported.droppedFrames, "Receive queue full, samples dropped: ");
+	report_counter(counters.lostPackets, reported.lostPackets, "Packets lost in transit: ");
+	report_counter(counters.latePackets, reported.latePackets, "Late packets discarded: ");
+	report_counter(counters.malformedPackets, reported.malformedPackets, "Malformed packets discarded: ");
+	report_counter(counters.unroutedPackets, reported.unroutedPackets, "Packets from senders without a stream discarded: ");
+	report_counter((int64) recorder.getDroppedPackets(), reportedCaptureDrops, "Capture writer behind, packets not recorded: ");
+
+	double last_timestamp = 0;
+
+	for (size_t s = 0; s < streamBlocks.size(); s++)
+	{
+		const UdpReceiver::StreamBlock& block = streamBlocks[s];
+		if (block.numFrames == 0)
+			continue;
 
-	packet_queue_count = 0;
+		dataBuffers[s]->addToBuffer(block.dest,
+		                            block.sampleNumbers,
+		                            block.timestamps,
+		                            eventCodes.data(),
+		                            block.numFrames);
 
-	dataBuffer->addToBuffer(data_points,
-                           sample_numbers,
-                           timestamps,
-                           event_codes,
-                           packet_count);
+		last_timestamp = std::max(last_timestamp, block.timestamps[block.numFrames - 1]);
+	}
 
 	// Metrics
 
-	tp t = get_time();
-	long deltatime = std::chrono::duration_cast<std::chrono::microseconds>(t - last_buffer_update).count() + 1; // +1 to prevent  / 0 errors
+	auto t = std::chrono::steady_clock::now();
+	long deltatime = std::chrono::duration_cast<std::chrono::microseconds>(t - lastBufferUpdate).count() + 1; // +1 to prevent  / 0 errors
 
 	const float to_seconds = 0.000001;
 
 	float packet_avg = 0.1;
 
 	float rate = (float) packet_count / (deltatime * to_seconds);
-	packet_rate = packet_rate * (1 - packet_avg) + rate * packet_avg;
+	packetRate = packetRate * (1 - packet_avg) + rate * packet_avg;
 
-	last_buffer_update = t;
+	lastBufferUpdate = t;
 
 
-	metric_data_points[0] = packet_rate;
-	metric_sample_numbers[0] = totalSamples++;
+	metricDataPoints[0] = packetRate;
+	metricDataPoints[1] = (float) counters.kernelDrops;
+	metricDataPoints[2] = (float) counters.lostPackets;
+	metricDataPoints[3] = (float) counters.latePackets;
+	metricDataPoints[4] = (float) counters.duplicatePackets;
+	metricDataPoints[5] = (float) counters.unroutedPackets;
+	metricSampleNumber = totalSamples++;
+	metricTimestamp = last_timestamp;
 
-	metricsDataBuffer->addToBuffer(metric_data_points, 
-								   metric_sample_numbers, 
-								   metric_timestamps, 
-								   metric_event_codes, 
+	metricsDataBuffer->addToBuffer(metricDataPoints, 
+								   &metricSampleNumber, 
+								   &metricTimestamp, 
+								   &metricEventCode, 
 								   1);
 	
 
@@ -493,16 +327,19 @@ bool DataThreadPlugin::updateBuffer()
 
 bool DataThreadPlugin::stopAcquisition()
 {
-	last_buffer_update = get_time();
 	if (isThreadRunning())
 	{
 	  signalThreadShouldExit(); //stop thread
+	  receiver.wakeConsumer();
 	}
 
-	close_udp_thread();
+	receiver.stop();
+	recorder.stop(); // writes out whatever the receivers queued
 
 	waitForThreadToExit(500);
-	dataBuffer->clear();
+
+	for (DataBuffer* buffer : dataBuffers)
+		buffer->clear();
 
 	return true;
 }
@@ -524,33 +361,192 @@ void DataThreadPlugin::handleBroadcastMessage (const String& msg, const int64 me
 
 String DataThreadPlugin::handleConfigMessage (const String& msg)
 {
-    return "";
+    // "CALIBRATION <channel> <gain> [offset] [units]" sets one channel, "CALIBRATION CLEAR" removes them all
+    if (! msg.startsWithIgnoreCase ("CALIBRATION"))
+        return "";
+
+    const String arguments = msg.substring (11).trim();
+
+    if (arguments.equalsIgnoreCase ("CLEAR"))
+    {
+        channelCalibration.clear();
+    }
+    else
+    {
+        int channel;
+        ChannelCalibration calibration;
+        std::string error;
+
+        if (! CalibrationTable::parseLine (arguments.toStdString(), channel, calibration, error))
+            return "ERROR: " + String (error);
+
+        channelCalibration.set (channel, calibration);
+    }
+
+    CoreServices::updateSignalChain (sn->getEditor());
+    return "OK";
 }
 
 void DataThreadPlugin::parameterValueChanged (Parameter* param)
 {
 	if (param->getName().equalsIgnoreCase ("port"))
    {
-		int new_port = param->getValue();	
-		if (server_running)
-			restart_thread();
-		else
-			port = new_port;
+		receiverSettings.port = param->getValue();
+		receiver.setPort(receiverSettings.port);
 
-		LOGD ("Port changed to ", port); // log message
+		LOGD ("Port changed to ", receiverSettings.port); // log message
 	
+   }
+	else if (param->getName().equalsIgnoreCase ("bind_address"))
+   {
+	   receiverSettings.bindAddress = param->getValueAsString().trim().toStdString();
+   }
+	else if (param->getName().equalsIgnoreCase ("multicast_group"))
+   {
+	   receiverSettings.multicastGroup = param->getValueAsString().trim().toStdString();
+   }
+	else if (param->getName().equalsIgnoreCase ("multicast_interface"))
+   {
+	   receiverSettings.multicastInterface = param->getValueAsString().trim().toStdString();
    }
 	else if (param->getName().equalsIgnoreCase ("scale"))
    {
-	   data_scale = param->getValue();
+	   dataScale = param->getValue();
+
+	   // Registered as the bitVolts of uncalibrated channels
+	   CoreServices::updateSignalChain (sn->getEditor());
+   }
+	else if (param->getName().equalsIgnoreCase ("calibration_file"))
+   {
+	   const String path = param->getValueAsString();
+	   std::string error;
+
+	   if (path.isEmpty())
+	   {
+		   channelCalibration.clear();
+	   }
+	   else if (channelCalibration.load(path.toStdString(), error))
+	   {
+		   LOGC("Loaded calibrations for ", channelCalibration.size(), " channels from ", path);
+	   }
+	   else
+	   {
+		   LOGE("Cannot load calibration file: ", String(error));
+	   }
+
+	   CoreServices::updateSignalChain (sn->getEditor());
    }
 	else if (param->getName().equalsIgnoreCase ("channels"))
    {
-	   data_channels = param->getValue();
+	   receiverSettings.channels = param->getValue();
+
+	   // Channel list and buffer width depend on this
+	   CoreServices::updateSignalChain (sn->getEditor());
+   }
+	else if (param->getName().equalsIgnoreCase ("protocol"))
+   {
+	   receiverSettings.protocol = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("sample_format"))
+   {
+	   receiverSettings.sampleFormat = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("reorder_window"))
+   {
+	   receiverSettings.reorderWindow = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("gap_fill"))
+   {
+	   receiverSettings.gapPolicy = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("batch_size"))
+   {
+	   receiverSettings.batchSize = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("receivers"))
+   {
+	   receiverSettings.receivers = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("streams"))
+   {
+	   receiverSettings.streams = param->getValue();
+
+	   // One DataStream per sender stream
+	   CoreServices::updateSignalChain (sn->getEditor());
+   }
+	else if (param->getName().equalsIgnoreCase ("stream_senders"))
+   {
+	   receiverSettings.streamSenders = param->getValueAsString().trim().toStdString();
+
+	   std::vector<std::pair<SenderAddress, bool>> senders;
+	   std::string error;
+
+	   if (! SenderStreams::parseSenders(receiverSettings.streamSenders, receiverSettings.streams, senders, error))
+		   LOGE("Stream Senders: ", String(error));
    }
 	else if (param->getName().equalsIgnoreCase ("packet_hold"))
    {
-	   gui_refresh_min = param->getValue();
+	   receiver.setBlockSize(param->getValue());
+   }
+	else if (param->getName().equalsIgnoreCase ("target_latency"))
+   {
+	   receiver.setTargetLatency(param->getValue());
+   }
+	else if (param->getName().equalsIgnoreCase ("max_wait"))
+   {
+	   receiverSettings.maxWaitUs = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("backend"))
+   {
+	   receiverSettings.backend = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("receive_buffer"))
+   {
+	   receiverSettings.receiveBufferKb = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("busy_poll"))
+   {
+	   receiverSettings.busyPollUs = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("source"))
+   {
+	   receiverSettings.source = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("replay_file"))
+   {
+	   receiverSettings.replayFile = param->getValueAsString().toStdString();
+   }
+	else if (param->getName().equalsIgnoreCase ("replay_speed"))
+   {
+	   receiverSettings.replaySpeed = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("receiver_cpu"))
+   {
+	   receiverSettings.receiverCpu = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("receiver_priority"))
+   {
+	   receiverSettings.receiverPriority = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("acquisition_cpu"))
+   {
+	   acquisitionRequest.cpu = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("acquisition_priority"))
+   {
+	   acquisitionRequest.priority = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("capture"))
+   {
+	   captureEnabled = param->getValue();
+   }
+	else if (param->getName().equalsIgnoreCase ("capture_path"))
+   {
+	   capturePath = param->getValueAsString();
+   }
+	else if (param->getName().equalsIgnoreCase ("capture_segment"))
+   {
+	   captureSegmentMb = param->getValue();
    }
 }
 
@@ -565,14 +561,153 @@ void DataThreadPlugin::registerParameters()
                      0, // minimum value
                      65535, // maximum value
                      false); 
+	addStringParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "bind_address", // parameter name
+                     "Bind Address", // display name
+                     "Local IPv4 or IPv6 address to receive on, e.g. that of a dedicated acquisition NIC. Empty: any IPv4 address; '::' any IPv4 or IPv6 address (dual-stack). Link-local IPv6 addresses take a scope, e.g. fe80::1%eth1", // parameter description
+                     "", // default value
+                     true); 
+	addStringParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "multicast_group", // parameter name
+                     "Multicast Group", // display name
+                     "IPv4 (224.0.0.0 to 239.255.255.255) or IPv6 (ff00::/8) multicast group to join and receive on Port, so one sender can feed several machines; replaces Bind Address. Empty receives unicast", // parameter description
+                     "", // default value
+                     true); 
+	addStringParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "multicast_interface", // parameter name
+                     "Multicast Interface", // display name
+                     "Address or name (e.g. eth1) of the network interface to join the group on; IPv6 groups take a name. Empty uses the interface the routing table picks", // parameter description
+                     "", // default value
+                     true); 
 	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
                      "channels", // parameter name
                      "Channels", // display name
                      "Number of channels to pull data from, arbitrary max", // parameter description
                      1, // default value
-                     0, // minimum value
+                     1, // minimum value
                      MAX_DATA_CHANNELS, // maximum value
-                     false); 
+                     true); 
+	addCategoricalParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "protocol", // parameter name
+                     "Protocol", // display name
+                     "Raw: each datagram is one frame of samples in Sample Format. Header: datagrams start with a PacketHeader and may carry many frames", // parameter description
+                     { "Raw", "Header" }, // categories
+                     PROTOCOL_RAW, // default index
+                     true); 
+	addCategoricalParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "sample_format", // parameter name
+                     "Sample Format", // display name
+                     "Encoding of the samples in Raw protocol datagrams (LE/BE: little/big-endian, int24 packed in 3 bytes); Header protocol packets announce their own. Decoded values are scaled by the channel's calibration, or Data Scale if it has none", // parameter description
+                     { "int16 LE", "int16 BE", "int24 LE", "int24 BE", "int32 LE", "int32 BE", "float32 LE", "float32 BE" }, // categories
+                     (int) PacketSampleFormat::INT16_LE, // default index
+                     true); 
+	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "reorder_window", // parameter name
+                     "Reorder Window", // display name
+                     "Packets held back waiting for a late one before it is declared lost (Header protocol)", // parameter description
+                     8, // default value
+                     0, // minimum value
+                     256, // maximum value
+                     true); 
+	addCategoricalParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "gap_fill", // parameter name
+                     "Gap Fill", // display name
+                     "What replaces lost packets: zeros, the last received sample, or nothing (sample numbers jump)", // parameter description
+                     { "Zero", "Hold last", "Skip" }, // categories
+                     PacketSequencer::GAP_ZERO, // default index
+                     true); 
+	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "batch_size", // parameter name
+                     "Batch Size", // display name
+                     "Maximum number of datagrams pulled from the socket per receive call", // parameter description
+                     16, // default value
+                     1, // minimum value
+                     UdpReceiver::MAX_RECV_BATCH, // maximum value
+                     true); 
+	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "receivers", // parameter name
+                     "Receivers", // display name
+                     "Receiver threads, each with its own socket on the port; the kernel spreads senders across them. With the Header protocol each sender should have a receiver or a stream to itself", // parameter description
+                     1, // default value
+                     1, // minimum value
+                     UdpReceiver::MAX_RECEIVERS, // maximum value
+                     true); 
+	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "streams", // parameter name
+                     "Streams", // display name
+                     "Data streams the packets are split into by sender address and port, each with its own buffer and sequencing. Senders are given streams in order of arrival unless Stream Senders ties them; packets of further senders are discarded", // parameter description
+                     1, // default value
+                     1, // minimum value
+                     SenderStreams::MAX_STREAMS, // maximum value
+                     true); 
+	addStringParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "stream_senders", // parameter name
+                     "Stream Senders", // display name
+                     "Senders of the first streams, in order, separated by commas: address or address:port, e.g. '10.0.0.5, 10.0.0.6:5000, [fe80::1]:5000'. Without a port any port of the address matches. Streams not listed go to other senders in order of arrival", // parameter description
+                     "", // default value
+                     true); 
+
+	addCategoricalParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "backend", // parameter name
+                     "Backend", // display name
+                     "How receivers read the socket: epoll with recvmmsg batches, or io_uring multishot receives (Linux 6.0+, falls back to epoll where unavailable)", // parameter description
+                     { "epoll", "io_uring" }, // categories
+                     BACKEND_EPOLL, // default index
+                     true); 
+
+	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "receive_buffer", // parameter name
+                     "Receive Buffer (KB)", // display name
+                     "Kernel receive queue per socket, to ride out stalls without drops. Above net.core.rmem_max it needs CAP_NET_ADMIN. 0 keeps the system default", // parameter description
+                     0, // default value
+                     0, // minimum value
+                     1048576, // maximum value
+                     true); 
+
+	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "busy_poll", // parameter name
+                     "Busy Poll (us)", // display name
+                     "SO_BUSY_POLL: how long a receive spins on the network device before sleeping, trading CPU for latency. Above net.core.busy_read it needs CAP_NET_ADMIN. 0 disables it", // parameter description
+                     0, // default value
+                     0, // minimum value
+                     10000, // maximum value
+                     true); 
+
+	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "receiver_cpu", // parameter name
+                     "Receiver Core", // display name
+                     "Core the first receiver thread is pinned to; further receivers take the following cores. -1 lets the scheduler place them", // parameter description
+                     -1, // default value
+                     -1, // minimum value
+                     1023, // maximum value
+                     true); 
+
+	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "receiver_priority", // parameter name
+                     "Receiver Priority", // display name
+                     "SCHED_FIFO priority of the receiver threads (1-99). Needs CAP_SYS_NICE or an rtprio limit, otherwise they run at normal priority. 0 keeps normal scheduling", // parameter description
+                     0, // default value
+                     0, // minimum value
+                     99, // maximum value
+                     true); 
+
+	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "acquisition_cpu", // parameter name
+                     "Acquisition Core", // display name
+                     "Core the acquisition thread, which moves samples into the signal chain, is pinned to. -1 lets the scheduler place it", // parameter description
+                     -1, // default value
+                     -1, // minimum value
+                     1023, // maximum value
+                     true); 
+
+	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "acquisition_priority", // parameter name
+                     "Acquisition Priority", // display name
+                     "SCHED_FIFO priority of the acquisition thread (1-99), with the same privileges as Receiver Priority. 0 keeps normal scheduling", // parameter description
+                     0, // default value
+                     0, // minimum value
+                     99, // maximum value
+                     true); 
 
 	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
                      "packet_hold", // parameter name
@@ -583,18 +718,98 @@ void DataThreadPlugin::registerParameters()
                      1000, // maximum value
                      false); 
 
+	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "max_wait", // parameter name
+                     "Max Wait (us)", // display name
+                     "Longest time a partially filled block waits before it is written to the buffer", // parameter description
+                     2000, // default value
+                     50, // minimum value
+                     1000000, // maximum value
+                     true); 
+
+	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "target_latency", // parameter name
+                     "Target Latency (us)", // display name
+                     "Time each block should span; the block size follows the measured packet rate and a partial block waits no longer than this. 0 uses Packet Hold instead", // parameter description
+                     0, // default value
+                     0, // minimum value
+                     1000000, // maximum value
+                     false); 
+
+	addCategoricalParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "source", // parameter name
+                     "Source", // display name
+                     "Network: receive UDP packets on the port. Replay: play back the datagrams of a capture file", // parameter description
+                     { "Network", "Replay" }, // categories
+                     SOURCE_NETWORK, // default index
+                     true); 
+
+	addPathParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "replay_file", // parameter name
+                     "Replay File", // display name
+                     "Capture (.oecap, following segments are read too) or pcap file to replay; from pcap files the UDP datagrams to Port are used", // parameter description
+                     File(), // default value
+                     { "*.oecap", "*.pcap" }, // valid file extensions
+                     false, // is a directory
+                     true); 
+
+	addFloatParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "replay_speed", // parameter name
+                     "Replay Speed", // display name
+                     "Multiple of the captured packet timing to replay at; 0 replays as fast as the signal chain keeps up", // parameter description
+					 "x",
+                     1, // default value
+                     0, // minimum value
+                     1000, // maximum value
+					 0.25,
+                     true); 
+
+	addBooleanParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "capture", // parameter name
+                     "Capture", // display name
+                     "Also write every received datagram, with its receive time, to capture files for later replay", // parameter description
+                     false, // default value
+                     true); 
+
+	addPathParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "capture_path", // parameter name
+                     "Capture Directory", // display name
+                     "Directory the capture files are written to; empty uses the recording directory", // parameter description
+                     File(), // default value
+                     {}, // valid file extensions
+                     true, // is a directory
+                     true); 
+
+	addIntParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "capture_segment", // parameter name
+                     "Capture Segment (MB)", // display name
+                     "Size of each preallocated capture file; a new one is started when it is full", // parameter description
+                     256, // default value
+                     16, // minimum value
+                     4096, // maximum value
+                     true); 
+
 
 
 	addFloatParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
                      "scale", // parameter name
                      "Data Scale", // display name
-                     "Scale of all channels", // parameter description
+                     "Scale of the channels without a calibration, also registered as their bitVolts", // parameter description
 					 "Unit",
                      25, // default value
                      0, // minimum value
                      15000, // maximum value
 					 0.25,
-                     false); 
+                     true); 
+
+	addPathParameter (Parameter::PROCESSOR_SCOPE, // parameter scope
+                     "calibration_file", // parameter name
+                     "Calibration File", // display name
+                     "Text file with one line per channel: channel gain [offset] [units]. Each calibrated channel is decoded as sample * gain + offset and registered with gain as its bitVolts", // parameter description
+                     File(), // default value
+                     { "*.txt", "*.csv" }, // valid file extensions
+                     false, // is a directory
+                     true); 
 }
 
 
@@ -26,6 +26,14 @@
 
 #include <DataThreadHeaders.h>
 
+#include "ChannelCalibration.h"
+#include "UdpReceiver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
 class DataThreadPlugin : public DataThread
 {
 public:
@@ -83,6 +91,67 @@ public:
     /** Called when a parameter value is updated, to allow plugin-specific responses */    
     void parameterValueChanged (Parameter* parameter) override;
 
+    /** Core and priority the receiver threads got, for the editor */
+    ThreadScheduling getReceiverScheduling() const { return receiver.getScheduling(); }
+
+    /** Core and priority the acquisition thread got, for the editor */
+    ThreadScheduling getAcquisitionScheduling() const { return acquisitionScheduling; }
+
+private:
+    static constexpr int METRICS_CHANNELS = 6; // packet rate, kernel drops, lost, late, duplicate and unrouted packets
+    static constexpr int MAX_SAMPLES_PER_CHANNEL = 1024;
+
+    /** Optional copy of every datagram to disk; declared first so it outlives the receiver threads */
+    PacketRecorder recorder;
+
+    /** Receiver threads and their queues; stopped when the plugin is destroyed */
+    UdpReceiver receiver;
+
+    /** Receiver configuration, as set by the parameters */
+    UdpReceiver::Settings receiverSettings;
+
+    float dataScale = 25;
+
+    /** Per-channel gain and offset, from a calibration file or config messages */
+    CalibrationTable channelCalibration;
+
+    // What the decode applies to each channel, and registers as its bitVolts; rebuilt by updateSettings
+    std::vector<float> channelGains;
+    std::vector<float> channelOffsets;
+
+    // Capture settings, as set by the parameters
+    bool captureEnabled = false;
+    String capturePath; // empty: the GUI's recording directory
+    int captureSegmentMb = 256;
+
+    /** Requested core and priority of the acquisition thread, applied by its first updateBuffer() */
+    ThreadScheduling acquisitionRequest;
+    std::atomic<ThreadScheduling> acquisitionScheduling { ThreadScheduling() };
+    bool acquisitionScheduled = false;
+
+    std::vector<DataBuffer*> dataBuffers; // one per sender stream
+    DataBuffer* metricsDataBuffer = nullptr;
+
+    // One block of samples per sender stream, each sized for MAX_DATA_CHANNELS; resized by updateSettings
+    std::vector<float> dataPoints;
+    std::vector<int64> sampleNumbers;
+    std::vector<double> timestamps;
+    std::vector<uint64> eventCodes;
+    std::vector<UdpReceiver::StreamBlock> streamBlocks;
+
+    // One metrics sample per block
+    float metricDataPoints[METRICS_CHANNELS] = {};
+    int64 metricSampleNumber = 0;
+    double metricTimestamp = 0;
+    uint64 metricEventCode = 0;
+
+    int64 totalSamples = 0;
+    std::chrono::steady_clock::time_point lastBufferUpdate;
+    float packetRate = 0;
+
+    /** Counter values already written to the log */
+    UdpReceiver::Counters reported;
+    int64 reportedCaptureDrops = 0;
 };
 
 #endif
\ No newline at end of file
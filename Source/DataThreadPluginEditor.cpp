@@ -26,8 +26,8 @@
 DataThreadPluginEditor::DataThreadPluginEditor (GenericProcessor* parentNode, DataThreadPlugin* plugin)
     : GenericEditor (parentNode)
 {
-    desiredWidth = 150; // sets the width of the plugin editor
-    this->thread = thread;
+    desiredWidth = 270; // sets the width of the plugin editor
+    this->thread = plugin;
 
 	// Parameters
 	addBoundedValueParameterEditor (Parameter::PROCESSOR_SCOPE, // parameter scope
@@ -44,6 +44,35 @@ DataThreadPluginEditor::DataThreadPluginEditor (GenericProcessor* parentNode, Da
                                   15, // x pos
                                   65); // y pos
 
+	// Scheduling the threads actually got, which may fall short of the parameters
+	receiverSchedulingLabel = std::make_unique<Label> ("Receiver scheduling", "Receive: -");
+	receiverSchedulingLabel->setFont (Font ("Fira Code", 12, Font::plain));
+	receiverSchedulingLabel->setJustificationType (Justification::centredLeft);
+	receiverSchedulingLabel->setBounds (140, 35, 125, 20);
+	addAndMakeVisible (receiverSchedulingLabel.get());
+
+	acquisitionSchedulingLabel = std::make_unique<Label> ("Acquisition scheduling", "Acquire: -");
+	acquisitionSchedulingLabel->setFont (Font ("Fira Code", 12, Font::plain));
+	acquisitionSchedulingLabel->setJustificationType (Justification::centredLeft);
+	acquisitionSchedulingLabel->setBounds (140, 55, 125, 20);
+	addAndMakeVisible (acquisitionSchedulingLabel.get());
+}
+
+void DataThreadPluginEditor::startAcquisition()
+{
+	startTimer (500);
+}
+
+void DataThreadPluginEditor::stopAcquisition()
+{
+	stopTimer();
+	timerCallback();
+}
+
+void DataThreadPluginEditor::timerCallback()
+{
+	receiverSchedulingLabel->setText ("Receive: " + String (describeThreadScheduling (thread->getReceiverScheduling())), dontSendNotification);
+	acquisitionSchedulingLabel->setText ("Acquire: " + String (describeThreadScheduling (thread->getAcquisitionScheduling())), dontSendNotification);
 }
 
 
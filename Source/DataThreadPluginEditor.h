@@ -28,7 +28,8 @@
 
 #include "DataThreadPlugin.h"
 
-class DataThreadPluginEditor : public GenericEditor
+class DataThreadPluginEditor : public GenericEditor,
+                               public Timer
 {
 public:
     /** The class constructor, used to initialize any members. */
@@ -37,8 +38,21 @@ public:
     /** The class destructor, used to deallocate memory */
     ~DataThreadPluginEditor() {}
 
+    /** Starts showing the scheduling the threads got */
+    void startAcquisition() override;
+
+    /** Stops updating the scheduling; the last state stays on display */
+    void stopAcquisition() override;
+
+    /** Refreshes the scheduling labels */
+    void timerCallback() override;
+
 private:
 
+    /** Achieved policy and core of the receiver and acquisition threads */
+    std::unique_ptr<Label> receiverSchedulingLabel;
+    std::unique_ptr<Label> acquisitionSchedulingLabel;
+
     /** A pointer to the underlying DataThreadPlugin */
     DataThreadPlugin* thread;
 
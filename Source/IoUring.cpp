@@ -0,0 +1,270 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include "IoUring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+// The ring indices are shared with the kernel: read its side with acquire, publish ours with release
+static unsigned loadAcquire (const unsigned* p)
+{
+    return __atomic_load_n (p, __ATOMIC_ACQUIRE);
+}
+
+static void storeRelease (unsigned* p, unsigned value)
+{
+    __atomic_store_n (p, value, __ATOMIC_RELEASE);
+}
+
+// ------------------------------------------------------------
+
+IoUring::IoUring()
+{
+}
+
+IoUring::~IoUring()
+{
+    close();
+}
+
+bool IoUring::setup (unsigned entries)
+{
+    close();
+
+    io_uring_params params {};
+    // Completions are only ever reaped by this thread
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+
+    ringFd = (int) syscall (__NR_io_uring_setup, entries, &params);
+
+    if (ringFd < 0)
+    {
+        // Kernels before 6.1 reject the flags; they are only an optimisation
+        params = {};
+        ringFd = (int) syscall (__NR_io_uring_setup, entries, &params);
+    }
+
+    if (ringFd < 0)
+    {
+        ringFd = -1;
+        return false;
+    }
+
+    sqMappingSize = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+    cqMappingSize = params.cq_off.cqes + params.cq_entries * sizeof (io_uring_cqe);
+
+    const bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMapping)
+        sqMappingSize = cqMappingSize = std::max (sqMappingSize, cqMappingSize);
+
+    sqMapping = mmap (nullptr, sqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqMapping == MAP_FAILED)
+    {
+        sqMapping = nullptr;
+        close();
+        return false;
+    }
+
+    if (singleMapping)
+    {
+        cqMapping = sqMapping;
+    }
+    else
+    {
+        cqMapping = mmap (nullptr, cqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqMapping == MAP_FAILED)
+        {
+            cqMapping = nullptr;
+            close();
+            return false;
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof (io_uring_sqe);
+    void* sqeMapping = mmap (nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqeMapping == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*> (sqeMapping);
+
+    char* sq = static_cast<char*> (sqMapping);
+    sqHead = reinterpret_cast<unsigned*> (sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*> (sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*> (sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*> (sq + params.sq_off.array);
+    sqLocalTail = *sqTail;
+
+    // Submission slots map one to one onto entries
+    for (unsigned i = 0; i < params.sq_entries; i++)
+        sqArray[i] = i;
+
+    char* cq = static_cast<char*> (cqMapping);
+    cqHead = reinterpret_cast<unsigned*> (cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*> (cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*> (cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*> (cq + params.cq_off.cqes);
+
+    return true;
+}
+
+bool IoUring::setupBufferRing (uint16_t groupId, unsigned count, size_t bufferSize_)
+{
+    if (ringFd < 0 || count == 0 || (count & (count - 1)) != 0 || count > 32768)
+        return false;
+
+    // The ring of buffer descriptors must be page aligned; the buffers follow it
+    const size_t pageSize = (size_t) sysconf (_SC_PAGESIZE);
+    const size_t ringSize = (count * sizeof (io_uring_buf) + pageSize - 1) & ~(pageSize - 1);
+
+    bufferMappingSize = ringSize + (size_t) count * bufferSize_;
+    bufferMapping = mmap (nullptr, bufferMappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (bufferMapping == MAP_FAILED)
+    {
+        bufferMapping = nullptr;
+        return false;
+    }
+
+    // Entries are addressed directly: in C++, io_uring_buf_ring::bufs does not start at offset 0
+    bufferEntries = static_cast<io_uring_buf*> (bufferMapping);
+    buffers = static_cast<char*> (bufferMapping) + ringSize;
+    bufferSize = bufferSize_;
+    bufferCount = count;
+    bufferGroup = groupId;
+
+    io_uring_buf_reg registration {};
+    registration.ring_addr = (uint64_t) (uintptr_t) bufferEntries;
+    registration.ring_entries = count;
+    registration.bgid = groupId;
+
+    if (syscall (__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0)
+    {
+        munmap (bufferMapping, bufferMappingSize);
+        bufferMapping = nullptr;
+        bufferEntries = nullptr;
+        buffers = nullptr;
+        return false;
+    }
+
+    bufferRingRegistered = true;
+
+    // Hand every buffer to the kernel
+    bufferTail = 0;
+    for (unsigned id = 0; id < count; id++)
+        recycleBuffer (id);
+    publishBuffers();
+
+    return true;
+}
+
+io_uring_sqe* IoUring::getSqe()
+{
+    if (sqLocalTail - loadAcquire (sqHead) > sqMask)
+        return nullptr;
+
+    io_uring_sqe* sqe = &sqes[sqLocalTail & sqMask];
+    memset (sqe, 0, sizeof (*sqe));
+    sqLocalTail++;
+
+    return sqe;
+}
+
+int IoUring::submitAndWait (unsigned waitFor)
+{
+    const unsigned toSubmit = sqLocalTail - *sqTail;
+    storeRelease (sqTail, sqLocalTail);
+
+    const int result = (int) syscall (__NR_io_uring_enter, ringFd, toSubmit, waitFor,
+                                      waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+
+    return result < 0 ? -errno : result;
+}
+
+io_uring_cqe* IoUring::peekCqe()
+{
+    const unsigned head = *cqHead;
+
+    if (head == loadAcquire (cqTail))
+        return nullptr;
+
+    return &cqes[head & cqMask];
+}
+
+void IoUring::cqeSeen()
+{
+    storeRelease (cqHead, *cqHead + 1);
+}
+
+void IoUring::recycleBuffer (unsigned bufferId)
+{
+    io_uring_buf& entry = bufferEntries[bufferTail & (bufferCount - 1)];
+    entry.addr = (uint64_t) (uintptr_t) getBuffer (bufferId);
+    entry.len = (uint32_t) bufferSize;
+    entry.bid = (uint16_t) bufferId;
+    bufferTail++;
+}
+
+void IoUring::publishBuffers()
+{
+    __atomic_store_n (&bufferEntries[0].resv, bufferTail, __ATOMIC_RELEASE);
+}
+
+void IoUring::close()
+{
+    if (bufferRingRegistered)
+    {
+        io_uring_buf_reg registration {};
+        registration.bgid = bufferGroup;
+        syscall (__NR_io_uring_register, ringFd, IORING_UNREGISTER_PBUF_RING, &registration, 1);
+        bufferRingRegistered = false;
+    }
+
+    if (bufferMapping != nullptr)
+        munmap (bufferMapping, bufferMappingSize);
+    bufferMapping = nullptr;
+    bufferEntries = nullptr;
+    buffers = nullptr;
+
+    if (sqes != nullptr)
+        munmap (sqes, sqesSize);
+    sqes = nullptr;
+
+    if (cqMapping != nullptr && cqMapping != sqMapping)
+        munmap (cqMapping, cqMappingSize);
+    cqMapping = nullptr;
+
+    if (sqMapping != nullptr)
+        munmap (sqMapping, sqMappingSize);
+    sqMapping = nullptr;
+
+    if (ringFd >= 0)
+        ::close (ringFd);
+    ringFd = -1;
+}
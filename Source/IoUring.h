@@ -0,0 +1,116 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef IOURING_H_DEFINED
+#define IOURING_H_DEFINED
+
+#include <linux/io_uring.h>
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+    Just enough of io_uring, on the raw system calls, for one thread to run
+    multishot receives: a submission and a completion ring, and one ring of
+    provided buffers the kernel picks receive buffers from.
+
+    Everything is owned by a single thread. Any setup step fails cleanly on
+    kernels (or sandboxes) without the features, so the caller can fall back
+    to another backend.
+*/
+class IoUring
+{
+public:
+    IoUring();
+    ~IoUring();
+
+    /** Creates the rings; returns false if io_uring is unavailable */
+    bool setup (unsigned entries);
+
+    /**
+        Allocates count buffers of bufferSize bytes (count a power of two) and
+        registers them as provided buffer group groupId. Returns false if the
+        kernel does not support buffer rings.
+    */
+    bool setupBufferRing (uint16_t groupId, unsigned count, size_t bufferSize);
+
+    /** Returns a cleared submission entry, or nullptr if the ring is full */
+    io_uring_sqe* getSqe();
+
+    /** Submits pending entries and waits until at least waitFor completions are queued; returns -errno on failure */
+    int submitAndWait (unsigned waitFor);
+
+    /** Returns the oldest unseen completion, or nullptr if there is none */
+    io_uring_cqe* peekCqe();
+
+    /** Hands the completion returned by peekCqe() back to the kernel */
+    void cqeSeen();
+
+    /** Returns the provided buffer with the given id */
+    char* getBuffer (unsigned bufferId) const { return buffers + (size_t) bufferId * bufferSize; }
+
+    /** Gives a buffer back to the kernel; takes effect at the next publishBuffers() */
+    void recycleBuffer (unsigned bufferId);
+
+    /** Makes recycled buffers available to the kernel again */
+    void publishBuffers();
+
+    size_t getBufferSize() const { return bufferSize; }
+
+private:
+    void close();
+
+    int ringFd = -1;
+
+    // Submission ring
+    void* sqMapping = nullptr;
+    size_t sqMappingSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* sqArray = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+    unsigned sqLocalTail = 0; // entries handed out, not yet submitted past sqTail
+
+    // Completion ring; shares sqMapping when the kernel supports a single mapping
+    void* cqMapping = nullptr;
+    size_t cqMappingSize = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    // Provided buffers
+    void* bufferMapping = nullptr;
+    size_t bufferMappingSize = 0;
+    io_uring_buf* bufferEntries = nullptr; // the ring's tail lives in the first entry's resv field
+    char* buffers = nullptr;
+    size_t bufferSize = 0;
+    unsigned bufferCount = 0;
+    uint16_t bufferTail = 0; // recycled, not yet published
+    uint16_t bufferGroup = 0;
+    bool bufferRingRegistered = false;
+};
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef PACKETHEADER_H_DEFINED
+#define PACKETHEADER_H_DEFINED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <endian.h>
+
+/**
+    Optional header at the start of every datagram when the "protocol"
+    parameter is set to "Header". All fields are little-endian.
+
+    The payload follows immediately after headerSize bytes and holds
+    samplesPerPacket frames, each made of channels samples in sampleFormat,
+    frame-major (all channels of the first sample, then the next sample...).
+    Senders may append fields in later versions by growing headerSize.
+*/
+struct PacketHeader
+{
+    uint32_t magic;            // PACKET_MAGIC
+    uint16_t version;          // PACKET_VERSION
+    uint16_t headerSize;       // bytes before the payload
+    uint64_t sequence;         // incremented by one for every packet sent
+    uint64_t timestamp;        // sender clock in nanoseconds, first sample of the packet
+    uint16_t channels;         // samples per frame
+    uint16_t samplesPerPacket; // frames in the payload
+    uint8_t sampleFormat;      // PacketSampleFormat
+    uint8_t reserved[3];
+};
+
+static_assert (sizeof (PacketHeader) == 32, "PacketHeader must match the wire layout");
+
+/** "OEUP" as read from the first four bytes of a little-endian datagram */
+constexpr uint32_t PACKET_MAGIC = 0x5055454F;
+constexpr uint16_t PACKET_VERSION = 1;
+
+/**
+    Encodings a header may announce for its payload, also selectable for the
+    Raw protocol. Integer formats are two's complement; INT24 samples are
+    packed into 3 bytes. Each little-endian format is even and its
+    big-endian counterpart the odd value after it.
+*/
+enum class PacketSampleFormat : uint8_t
+{
+    INT16_LE = 0,
+    INT16_BE = 1,
+    INT24_LE = 2,
+    INT24_BE = 3,
+    INT32_LE = 4,
+    INT32_BE = 5,
+    FLOAT32_LE = 6,
+    FLOAT32_BE = 7
+};
+
+constexpr int NUM_SAMPLE_FORMATS = 8;
+
+/** Largest sample, in bytes, of any format */
+constexpr size_t MAX_SAMPLE_SIZE = 4;
+
+/** Returns the size of one sample in the given format, or 0 if unknown */
+constexpr size_t getSampleSize (uint8_t format)
+{
+    switch ((PacketSampleFormat) format)
+    {
+        case PacketSampleFormat::INT16_LE:
+        case PacketSampleFormat::INT16_BE:
+            return 2;
+        case PacketSampleFormat::INT24_LE:
+        case PacketSampleFormat::INT24_BE:
+            return 3;
+        case PacketSampleFormat::INT32_LE:
+        case PacketSampleFormat::INT32_BE:
+        case PacketSampleFormat::FLOAT32_LE:
+        case PacketSampleFormat::FLOAT32_BE:
+            return 4;
+    }
+
+    return 0;
+}
+
+/** Outcome of parsePacketHeader() */
+enum class PacketStatus
+{
+    OK,
+    TOO_SHORT,      // shorter than the fixed header or its headerSize
+    BAD_MAGIC,      // not a framed packet
+    BAD_VERSION,    // newer major version than this reader understands
+    BAD_FORMAT,     // unknown sample format
+    SIZE_MISMATCH   // payload length disagrees with channels x samplesPerPacket
+};
+
+/**
+    Decodes and validates the header of a datagram of the given length.
+    On success the payload starts at data + header.headerSize.
+*/
+inline PacketStatus parsePacketHeader (const char* data, size_t length, PacketHeader& header)
+{
+    if (length < sizeof (PacketHeader))
+        return PacketStatus::TOO_SHORT;
+
+    memcpy (&header, data, sizeof (PacketHeader));
+
+    header.magic = le32toh (header.magic);
+    header.version = le16toh (header.version);
+    header.headerSize = le16toh (header.headerSize);
+    header.sequence = le64toh (header.sequence);
+    header.timestamp = le64toh (header.timestamp);
+    header.channels = le16toh (header.channels);
+    header.samplesPerPacket = le16toh (header.samplesPerPacket);
+
+    if (header.magic != PACKET_MAGIC)
+        return PacketStatus::BAD_MAGIC;
+
+    if (header.version != PACKET_VERSION)
+        return PacketStatus::BAD_VERSION;
+
+    if (header.headerSize < sizeof (PacketHeader) || header.headerSize > length)
+        return PacketStatus::TOO_SHORT;
+
+    const size_t sampleSize = getSampleSize (header.sampleFormat);
+
+    if (sampleSize == 0)
+        return PacketStatus::BAD_FORMAT;
+
+    if (length - header.headerSize != (size_t) header.channels * header.samplesPerPacket * sampleSize)
+        return PacketStatus::SIZE_MISMATCH;
+
+    return PacketStatus::OK;
+}
+
+/** Fills the first sizeof (PacketHeader) bytes of an outgoing datagram */
+inline void writePacketHeader (char* data,
+                               uint64_t sequence,
+                               uint64_t timestamp,
+                               uint16_t channels,
+                               uint16_t samplesPerPacket,
+                               PacketSampleFormat format)
+{
+    PacketHeader header {};
+    header.magic = htole32 (PACKET_MAGIC);
+    header.version = htole16 (PACKET_VERSION);
+    header.headerSize = htole16 ((uint16_t) sizeof (PacketHeader));
+    header.sequence = htole64 (sequence);
+    header.timestamp = htole64 (timestamp);
+    header.channels = htole16 (channels);
+    header.samplesPerPacket = htole16 (samplesPerPacket);
+    header.sampleFormat = (uint8_t) format;
+
+    memcpy (data, &header, sizeof (PacketHeader));
+}
+
+/** Encodes one sample for an outgoing payload; integer formats take value rounded and clamped to their range */
+inline void writeSample (char* data, PacketSampleFormat format, double value)
+{
+    const bool bigEndian = ((uint8_t) format & 1) != 0;
+    const size_t size = getSampleSize ((uint8_t) format);
+    uint32_t bits;
+
+    if (format == PacketSampleFormat::FLOAT32_LE || format == PacketSampleFormat::FLOAT32_BE)
+    {
+        const float f = (float) value;
+        memcpy (&bits, &f, sizeof (bits));
+    }
+    else
+    {
+        const double limit = (double) (1LL << (size * 8 - 1));
+        const double clamped = value < -limit ? -limit : (value > limit - 1 ? limit - 1 : value);
+        bits = (uint32_t) (int32_t) (clamped < 0 ? clamped - 0.5 : clamped + 0.5);
+    }
+
+    for (size_t i = 0; i < size; i++)
+        data[bigEndian ? size - 1 - i : i] = (char) (bits >> (8 * i));
+}
+
+#endif
@@ -0,0 +1,290 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include "PacketRecorder.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+/** Copies length bytes into the ring's unpublished space, starting offset bytes in */
+static void copyToRing (SpscRingBuffer<char>& ring, size_t offset, const void* data, size_t length)
+{
+    const char* source = static_cast<const char*> (data);
+
+    while (length > 0)
+    {
+        const size_t chunk = ring.contiguousWritable (length, offset);
+        memcpy (&ring.writeSlot (offset), source, chunk);
+        source += chunk;
+        offset += chunk;
+        length -= chunk;
+    }
+}
+
+/** Copies length published bytes out of the ring, starting offset bytes in */
+static void copyFromRing (const SpscRingBuffer<char>& ring, size_t offset, void* dest, size_t length)
+{
+    char* target = static_cast<char*> (dest);
+
+    while (length > 0)
+    {
+        const size_t chunk = ring.contiguousReadable (length, offset);
+        memcpy (target, &ring.readSlot (offset), chunk);
+        target += chunk;
+        offset += chunk;
+        length -= chunk;
+    }
+}
+
+static int64_t realtimeNs()
+{
+    timespec ts;
+    clock_gettime (CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// ------------------------------------------------------------
+
+PacketRecorder::PacketRecorder()
+{
+}
+
+PacketRecorder::~PacketRecorder()
+{
+    stop();
+}
+
+bool PacketRecorder::start (const std::string& directory_, size_t segmentBytes_, int numReceivers, int protocol_)
+{
+    stop();
+
+    directory = directory_;
+    segmentBytes = std::max (segmentBytes_, MIN_SEGMENT_BYTES);
+    protocol = protocol_;
+    segmentIndex = 0;
+
+    // All segments of one capture share the time it started
+    char stamp[32];
+    const time_t now = time (nullptr);
+    tm local;
+    localtime_r (&now, &local);
+    strftime (stamp, sizeof (stamp), "%Y%m%d_%H%M%S", &local);
+    baseName = std::string ("udp_capture_") + stamp;
+
+    rings.resize (std::max (numReceivers, 1));
+
+    for (auto& ring : rings)
+    {
+        if (ring == nullptr)
+            ring = std::make_unique<ByteRing> (RING_BYTES);
+
+        ring->reset();
+    }
+
+    droppedPackets = 0;
+
+    if (! openSegment())
+        return false;
+
+    stopRequested = false;
+    recording = true;
+    writer = std::thread (&PacketRecorder::writeLoop, this);
+
+    return true;
+}
+
+void PacketRecorder::stop()
+{
+    if (! writer.joinable())
+        return;
+
+    // The writer drains every ring before it exits
+    stopRequested = true;
+    writer.join();
+    recording = false;
+}
+
+void PacketRecorder::record (int receiver, int stream, const char* data, size_t length, int64_t receiveTimeNs)
+{
+    if (receiver < 0 || receiver >= (int) rings.size())
+        return;
+
+    ByteRing& ring = *rings[receiver];
+    const size_t size = getCaptureRecordSize (length);
+
+    if (ring.writeAvailable (size) < size)
+    {
+        // The writer has fallen behind; losing the copy is better than delaying the receiver
+        droppedPackets.fetch_add (1, std::memory_order_relaxed);
+        return;
+    }
+
+    CaptureRecordHeader header {};
+    header.receiveTimeNs = receiveTimeNs;
+    header.length = (uint32_t) length;
+    header.receiver = (uint16_t) receiver;
+    header.stream = stream < 0 ? CAPTURE_UNROUTED : (uint16_t) stream;
+
+    static const char padding[8] = {};
+
+    copyToRing (ring, 0, &header, sizeof (header));
+    copyToRing (ring, sizeof (header), data, length);
+    copyToRing (ring, sizeof (header) + length, padding, size - sizeof (header) - length);
+
+    ring.publish (size);
+}
+
+void PacketRecorder::writeLoop()
+{
+    while (! stopRequested)
+    {
+        bool wrote = false;
+
+        for (auto& ring : rings)
+            wrote |= drain (*ring);
+
+        if (! wrote)
+            std::this_thread::sleep_for (std::chrono::milliseconds (1));
+    }
+
+    // Receivers are stopped before the recorder, so this empties the rings for good
+    for (auto& ring : rings)
+        drain (*ring);
+
+    closeSegment();
+}
+
+bool PacketRecorder::drain (ByteRing& ring)
+{
+    size_t available = ring.readAvailable();
+    size_t consumed = 0;
+
+    // Records are published whole, so a visible header means its payload is there too
+    while (available - consumed >= sizeof (CaptureRecordHeader))
+    {
+        CaptureRecordHeader header;
+        copyFromRing (ring, consumed, &header, sizeof (header));
+        const size_t size = getCaptureRecordSize (header.length);
+
+        if (mapping != nullptr && writeOffset + size > segmentBytes)
+        {
+            closeSegment();
+            openSegment();
+        }
+
+        if (mapping != nullptr)
+        {
+            copyFromRing (ring, consumed, mapping + writeOffset, size);
+            writeOffset += size;
+            recordCount++;
+        }
+        else
+        {
+            droppedPackets.fetch_add (1, std::memory_order_relaxed);
+        }
+
+        consumed += size;
+    }
+
+    ring.release (consumed);
+
+    return consumed > 0;
+}
+
+bool PacketRecorder::openSegment()
+{
+    char suffix[16];
+    snprintf (suffix, sizeof (suffix), "_%04llu", (unsigned long long) segmentIndex);
+    const std::string path = directory + "/" + baseName + suffix + CAPTURE_EXTENSION;
+
+    fd = open (path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+        return false;
+
+    // Reserve the blocks up front so writing through the mapping never hits a full disk;
+    // filesystems without fallocate get a sparse file instead
+    if (posix_fallocate (fd, 0, (off_t) segmentBytes) != 0 && ftruncate (fd, (off_t) segmentBytes) != 0)
+    {
+        close (fd);
+        fd = -1;
+        unlink (path.c_str());
+        return false;
+    }
+
+    void* address = mmap (nullptr, segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED)
+    {
+        close (fd);
+        fd = -1;
+        unlink (path.c_str());
+        return false;
+    }
+
+    mapping = static_cast<char*> (address);
+    madvise (mapping, segmentBytes, MADV_SEQUENTIAL);
+
+    CaptureFileHeader header {};
+    memcpy (header.magic, CAPTURE_MAGIC, sizeof (header.magic));
+    header.version = CAPTURE_VERSION;
+    header.headerSize = sizeof (CaptureFileHeader);
+    header.segmentIndex = segmentIndex;
+    header.startTimeNs = realtimeNs();
+    header.protocol = (uint32_t) protocol;
+    memcpy (mapping, &header, sizeof (header));
+
+    writeOffset = sizeof (CaptureFileHeader);
+    recordCount = 0;
+    segmentIndex++;
+
+    return true;
+}
+
+void PacketRecorder::closeSegment()
+{
+    if (mapping == nullptr)
+        return;
+
+    CaptureFileHeader header;
+    memcpy (&header, mapping, sizeof (header));
+    header.dataSize = writeOffset - header.headerSize;
+    header.recordCount = recordCount;
+    memcpy (mapping, &header, sizeof (header));
+
+    munmap (mapping, segmentBytes);
+    mapping = nullptr;
+
+    // Drop the unused preallocated tail
+    if (ftruncate (fd, (off_t) writeOffset) != 0)
+    {
+        // Readers still stop at dataSize, the file is just longer than it needs to be
+    }
+
+    close (fd);
+    fd = -1;
+}
@@ -0,0 +1,105 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef PACKETRECORDER_H_DEFINED
+#define PACKETRECORDER_H_DEFINED
+
+#include "CaptureFile.h"
+#include "SpscRingBuffer.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+    Writes received datagrams to capture segment files (see CaptureFile.h).
+
+    Receiver threads only copy each datagram into their own lock-free ring;
+    a separate writer thread moves the records into a preallocated,
+    memory-mapped segment and opens the next one when it is full. When the
+    writer cannot keep up, records are dropped and counted instead of ever
+    stalling a receiver.
+*/
+class PacketRecorder
+{
+public:
+    static constexpr size_t RING_BYTES = 8 << 20; // per receiver
+    static constexpr size_t MIN_SEGMENT_BYTES = 1 << 20;
+
+    PacketRecorder();
+    ~PacketRecorder();
+
+    /**
+        Opens the first segment in directory and starts the writer thread.
+        Must be called while no receiver is running. Returns false, and
+        records nothing, if the segment cannot be created.
+    */
+    bool start (const std::string& directory, size_t segmentBytes, int numReceivers, int protocol);
+
+    /** Writes out everything queued, closes the segment and stops the writer */
+    void stop();
+
+    bool isRecording() const { return recording; }
+
+    /** Queues one datagram from the given receiver thread, routed to stream (negative if unrouted); never blocks */
+    void record (int receiver, int stream, const char* data, size_t length, int64_t receiveTimeNs);
+
+    /** Datagrams lost because a ring was full or a segment could not be written */
+    int64_t getDroppedPackets() const { return droppedPackets.load (std::memory_order_relaxed); }
+
+private:
+    typedef SpscRingBuffer<char> ByteRing;
+
+    /** Body of the writer thread */
+    void writeLoop();
+
+    /** Moves every complete record queued in ring into the segment; returns true if any were */
+    bool drain (ByteRing& ring);
+
+    /** Creates, preallocates and maps the next segment */
+    bool openSegment();
+
+    /** Finalises the header, unmaps the segment and trims it to its contents */
+    void closeSegment();
+
+    std::vector<std::unique_ptr<ByteRing>> rings; // one per receiver
+    std::thread writer;
+    std::atomic<bool> recording { false };
+    std::atomic<bool> stopRequested { false };
+    std::atomic<int64_t> droppedPackets { 0 };
+
+    // Writer thread only (and start/stop, while it is not running)
+    std::string directory;
+    std::string baseName;
+    size_t segmentBytes = 0;
+    int protocol = 0;
+    uint64_t segmentIndex = 0;
+    int fd = -1;
+    char* mapping = nullptr;
+    size_t writeOffset = 0;
+    uint64_t recordCount = 0;
+};
+
+#endif
@@ -0,0 +1,226 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include "PacketSequencer.h"
+
+#include "PacketHeader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+static int64_t steadyNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+PacketSequencer::PacketSequencer (Output& output_) : output (output_),
+                                                      history (HISTORY_SIZE, UINT64_MAX)
+{
+}
+
+void PacketSequencer::reset (int windowSize_, GapPolicy policy, int64_t firstSampleNumber, double samplePeriod_)
+{
+    windowSize = std::max (windowSize_, 0);
+    gapPolicy = policy;
+
+    started = false;
+    expected = 0;
+    nextSampleNumber = firstSampleNumber;
+    nextTimestamp = 0;
+    samplePeriod = samplePeriod_;
+
+    held.resize (windowSize);
+    for (auto& packet : held)
+        packet.valid = false;
+    heldCount = 0;
+
+    std::fill (history.begin(), history.end(), UINT64_MAX);
+
+    lastFrames = 1;
+    lastChannels = 0;
+    lastFormat = 0;
+    haveLastFrame = false;
+
+    lostPackets = 0;
+    latePackets = 0;
+    duplicatePackets = 0;
+}
+
+void PacketSequencer::addUnsequenced (const char* samples, int numFrames, int channels, uint8_t format, double firstTimestamp)
+{
+    output.writeFrames ({ samples, numFrames, channels, format, (size_t) channels * getSampleSize (format), nextSampleNumber, firstTimestamp, samplePeriod });
+    nextSampleNumber += numFrames;
+}
+
+void PacketSequencer::addPacket (uint64_t sequence, const char* samples, int numFrames, int channels, uint8_t format, double firstTimestamp)
+{
+    if (! started)
+    {
+        started = true;
+        expected = sequence;
+    }
+
+    if (sequence == expected)
+    {
+        emit (sequence, samples, numFrames, channels, format, firstTimestamp);
+        drainHeld();
+        return;
+    }
+
+    if (sequence < expected)
+    {
+        if (expected - sequence > RESYNC_THRESHOLD)
+        {
+            // Sender restarted its sequence
+            resync (sequence);
+            emit (sequence, samples, numFrames, channels, format, firstTimestamp);
+        }
+        else if (history[sequence % HISTORY_SIZE] == sequence)
+            duplicatePackets.fetch_add (1, std::memory_order_relaxed);
+        else
+            latePackets.fetch_add (1, std::memory_order_relaxed);
+
+        return;
+    }
+
+    if (sequence - expected > RESYNC_THRESHOLD)
+    {
+        // Too far ahead to be loss; don't synthesise thousands of packets
+        resync (sequence);
+        emit (sequence, samples, numFrames, channels, format, firstTimestamp);
+        return;
+    }
+
+    // The window covers expected + 1 ... expected + windowSize; give up on
+    // the oldest missing packets until this one fits
+    while (sequence - expected > (uint64_t) windowSize)
+    {
+        fillGap();
+        drainHeld();
+    }
+
+    if (sequence == expected)
+    {
+        emit (sequence, samples, numFrames, channels, format, firstTimestamp);
+        drainHeld();
+        return;
+    }
+
+    HeldPacket& slot = held[sequence % windowSize];
+
+    if (slot.valid)
+    {
+        // Slots map one-to-one onto the window, so this is the same packet
+        duplicatePackets.fetch_add (1, std::memory_order_relaxed);
+        return;
+    }
+
+    slot.valid = true;
+    slot.sequence = sequence;
+    slot.numFrames = numFrames;
+    slot.channels = channels;
+    slot.format = format;
+    slot.timestamp = firstTimestamp;
+    slot.samples.assign (samples, samples + (size_t) numFrames * channels * getSampleSize (format));
+
+    if (heldCount++ == 0)
+        heldSinceNs = steadyNowNs();
+}
+
+void PacketSequencer::flushExpired (int64_t nowNs, int64_t maxAgeNs)
+{
+    if (heldCount > 0 && nowNs - heldSinceNs >= maxAgeNs)
+        flush();
+}
+
+void PacketSequencer::flush()
+{
+    while (heldCount > 0)
+    {
+        fillGap();
+        drainHeld();
+    }
+}
+
+void PacketSequencer::emit (uint64_t sequence, const char* samples, int numFrames, int channels, uint8_t format, double firstTimestamp)
+{
+    const size_t frameBytes = (size_t) channels * getSampleSize (format);
+
+    output.writeFrames ({ samples, numFrames, channels, format, frameBytes, nextSampleNumber, firstTimestamp, samplePeriod });
+    nextSampleNumber += numFrames;
+    nextTimestamp = firstTimestamp + numFrames * samplePeriod;
+
+    history[sequence % HISTORY_SIZE] = sequence;
+    expected = sequence + 1;
+
+    lastFrames = numFrames;
+    lastChannels = channels;
+    lastFormat = format;
+
+    if (gapPolicy == GAP_HOLD_LAST && numFrames > 0)
+    {
+        fillFrame.assign (samples + (numFrames - 1) * frameBytes, samples + numFrames * frameBytes);
+        haveLastFrame = true;
+    }
+}
+
+void PacketSequencer::fillGap()
+{
+    lostPackets.fetch_add (1, std::memory_order_relaxed);
+    expected++;
+
+    // Assume the missing packet had the same shape as the last one received
+    if (gapPolicy != GAP_SKIP && lastChannels > 0)
+    {
+        if (gapPolicy == GAP_ZERO || ! haveLastFrame)
+            fillFrame.assign ((size_t) lastChannels * getSampleSize (lastFormat), 0); // zero in every format
+
+        output.writeFrames ({ fillFrame.data(), lastFrames, lastChannels, lastFormat, 0, nextSampleNumber, nextTimestamp, samplePeriod });
+    }
+
+    nextSampleNumber += lastFrames;
+    nextTimestamp += lastFrames * samplePeriod;
+}
+
+void PacketSequencer::drainHeld()
+{
+    while (heldCount > 0)
+    {
+        HeldPacket& slot = held[expected % windowSize];
+
+        if (! slot.valid || slot.sequence != expected)
+            return;
+
+        slot.valid = false;
+        heldCount--;
+
+        emit (slot.sequence, slot.samples.data(), slot.numFrames, slot.channels, slot.format, slot.timestamp);
+    }
+}
+
+void PacketSequencer::resync (uint64_t sequence)
+{
+    flush();
+    expected = sequence;
+}
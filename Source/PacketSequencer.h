@@ -0,0 +1,159 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef PACKETSEQUENCER_H_DEFINED
+#define PACKETSEQUENCER_H_DEFINED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+    Restores sender order for packets carrying a sequence number and assigns
+    continuous sample numbers to the frames they contain.
+
+    Up to windowSize packets ahead of the next expected one are held back so
+    that a late packet can still be slotted in. When the window overflows, or
+    the receiver gives up waiting (flushExpired), missing packets are declared
+    lost and replaced according to the gap policy. Lives entirely on the
+    receiver thread; only the counters may be read from elsewhere.
+*/
+class PacketSequencer
+{
+public:
+    /** What to emit in place of lost packets */
+    enum GapPolicy
+    {
+        GAP_ZERO = 0,      // frames of zeros
+        GAP_HOLD_LAST = 1, // repeat the last frame received
+        GAP_SKIP = 2       // emit nothing, sample numbers jump over the gap
+    };
+
+    /** A run of consecutive frames handed to the Output */
+    struct FrameRun
+    {
+        const char* samples;       // channels samples per frame, in sampleFormat
+        int numFrames;
+        int channels;
+        uint8_t sampleFormat;      // PacketSampleFormat
+        size_t frameStride;        // bytes between frames, 0 repeats a single frame
+        int64_t firstSampleNumber; // increments by one per frame
+        double firstTimestamp;     // seconds, increments by samplePeriod per frame
+        double samplePeriod;
+    };
+
+    /** Receives frames in order */
+    class Output
+    {
+    public:
+        virtual ~Output() {}
+
+        virtual void writeFrames (const FrameRun& run) = 0;
+    };
+
+    /** Largest jump in sequence numbers treated as loss rather than a sender restart */
+    static constexpr uint64_t RESYNC_THRESHOLD = 4096;
+
+    explicit PacketSequencer (Output& output);
+
+    /** Forgets all state; sample numbering restarts at firstSampleNumber */
+    void reset (int windowSize, GapPolicy policy, int64_t firstSampleNumber, double samplePeriod);
+
+    /** Adds a packet carrying a sequence number; firstTimestamp is the time of its first frame */
+    void addPacket (uint64_t sequence, const char* samples, int numFrames, int channels, uint8_t format, double firstTimestamp);
+
+    /** Adds frames that have no sequence number (raw protocol) */
+    void addUnsequenced (const char* samples, int numFrames, int channels, uint8_t format, double firstTimestamp);
+
+    /** True while packets are held back waiting for a missing one */
+    bool isHolding() const { return heldCount > 0; }
+
+    /** Gives up on missing packets if the oldest held packet has waited maxAgeNs */
+    void flushExpired (int64_t nowNs, int64_t maxAgeNs);
+
+    /** Gives up on all missing packets and emits everything held */
+    void flush();
+
+    int64_t getLostPackets() const { return lostPackets.load (std::memory_order_relaxed); }
+    int64_t getLatePackets() const { return latePackets.load (std::memory_order_relaxed); }
+    int64_t getDuplicatePackets() const { return duplicatePackets.load (std::memory_order_relaxed); }
+
+private:
+    struct HeldPacket
+    {
+        bool valid = false;
+        uint64_t sequence = 0;
+        int numFrames = 0;
+        int channels = 0;
+        uint8_t format = 0;
+        double timestamp = 0;
+        std::vector<char> samples;
+    };
+
+    /** Emits a received packet and remembers it for duplicate detection */
+    void emit (uint64_t sequence, const char* samples, int numFrames, int channels, uint8_t format, double firstTimestamp);
+
+    /** Declares the next expected packet lost and applies the gap policy */
+    void fillGap();
+
+    /** Emits held packets for as long as the next expected one is available */
+    void drainHeld();
+
+    /** Drops held packets and continues from sequence without filling */
+    void resync (uint64_t sequence);
+
+    Output& output;
+
+    GapPolicy gapPolicy = GAP_ZERO;
+    int windowSize = 0;
+
+    bool started = false;
+    uint64_t expected = 0;
+    int64_t nextSampleNumber = 0;
+
+    /** Where the frame after the last one emitted falls in time, for gap fills */
+    double nextTimestamp = 0;
+    double samplePeriod = 0;
+
+    std::vector<HeldPacket> held;
+    int heldCount = 0;
+    int64_t heldSinceNs = 0;
+
+    /** Sequence numbers of recently emitted packets, to tell duplicates from late arrivals */
+    static constexpr size_t HISTORY_SIZE = 1024;
+    std::vector<uint64_t> history;
+
+    /** Frame repeated by the gap policies, and the shape of the last packet */
+    std::vector<char> fillFrame;
+    int lastFrames = 1;
+    int lastChannels = 0;
+    uint8_t lastFormat = 0;
+    bool haveLastFrame = false;
+
+    std::atomic<int64_t> lostPackets { 0 };
+    std::atomic<int64_t> latePackets { 0 };
+    std::atomic<int64_t> duplicatePackets { 0 };
+};
+
+#endif
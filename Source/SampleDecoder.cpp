@@ -0,0 +1,427 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include "SampleDecoder.h"
+
+#include <endian.h>
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SAMPLEDECODER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace SampleDecoder
+{
+
+/** Reads one sample in format F; the format is fixed at compile time, so this never branches */
+template <PacketSampleFormat F>
+static inline float loadSample (const unsigned char* p)
+{
+    constexpr bool bigEndian = ((uint8_t) F & 1) != 0;
+    constexpr size_t size = getSampleSize ((uint8_t) F);
+
+    if constexpr (size == 2)
+    {
+        uint16_t bits;
+        memcpy (&bits, p, sizeof (bits));
+        return (int16_t) (bigEndian ? be16toh (bits) : le16toh (bits));
+    }
+    else if constexpr (size == 3)
+    {
+        const uint32_t bits = bigEndian ? (uint32_t) p[0] << 16 | (uint32_t) p[1] << 8 | p[2]
+                                        : (uint32_t) p[2] << 16 | (uint32_t) p[1] << 8 | p[0];
+        return (float) ((int32_t) (bits << 8) >> 8); // sign-extend from bit 23
+    }
+    else
+    {
+        uint32_t bits;
+        memcpy (&bits, p, sizeof (bits));
+        bits = bigEndian ? be32toh (bits) : le32toh (bits);
+
+        if constexpr (F == PacketSampleFormat::FLOAT32_LE || F == PacketSampleFormat::FLOAT32_BE)
+        {
+            float value;
+            memcpy (&value, &bits, sizeof (value));
+            return value;
+        }
+        else
+        {
+            return (float) (int32_t) bits;
+        }
+    }
+}
+
+/** Plain per-element loop, used on its own and for the edges of the vector kernels */
+template <PacketSampleFormat F>
+static void decodeRange (const SampleFrame* frames,
+                         int firstFrame,
+                         int lastFrame,
+                         int firstChannel,
+                         int lastChannel,
+                         const float* gains,
+                         const float* offsets,
+                         float* dest,
+                         int destStride)
+{
+    constexpr size_t sampleSize = getSampleSize ((uint8_t) F);
+
+    for (int ch = firstChannel; ch < lastChannel; ch++)
+    {
+        float* out = dest + (size_t) ch * destStride;
+        const size_t position = ch * sampleSize;
+        const float gain = gains[ch];
+        const float offset = offsets[ch];
+
+        for (int i = firstFrame; i < lastFrame; i++)
+            out[i] = loadSample<F> (frames[i].samples + position) * gain + offset;
+    }
+}
+
+/** Kernel for one format */
+template <PacketSampleFormat F>
+static void decodeFormat (const SampleFrame* frames,
+                          int numFrames,
+                          int numChannels,
+                          const float* gains,
+                          const float* offsets,
+                          float* dest,
+                          int destStride)
+{
+    decodeRange<F> (frames, 0, numFrames, 0, numChannels, gains, offsets, dest, destStride);
+}
+
+
+#ifdef SAMPLEDECODER_X86
+
+/**
+    Transposes an 8x8 block of int16 in place: on entry r[k] holds 8 channels of
+    frame k, on exit r[c] holds channel c of 8 consecutive frames. Each 128-bit
+    lane is transposed independently, so 256-bit registers handle two blocks.
+*/
+#define SAMPLEDECODER_TRANSPOSE8(T, UNPACKLO16, UNPACKHI16, UNPACKLO32, UNPACKHI32, UNPACKLO64, UNPACKHI64, r) \
+    {                                                                                                          \
+        T t0 = UNPACKLO16 (r[0], r[1]), t1 = UNPACKHI16 (r[0], r[1]);                                          \
+        T t2 = UNPACKLO16 (r[2], r[3]), t3 = UNPACKHI16 (r[2], r[3]);                                          \
+        T t4 = UNPACKLO16 (r[4], r[5]), t5 = UNPACKHI16 (r[4], r[5]);                                          \
+        T t6 = UNPACKLO16 (r[6], r[7]), t7 = UNPACKHI16 (r[6], r[7]);                                          \
+        T u0 = UNPACKLO32 (t0, t2), u1 = UNPACKHI32 (t0, t2);                                                  \
+        T u2 = UNPACKLO32 (t1, t3), u3 = UNPACKHI32 (t1, t3);                                                  \
+        T u4 = UNPACKLO32 (t4, t6), u5 = UNPACKHI32 (t4, t6);                                                  \
+        T u6 = UNPACKLO32 (t5, t7), u7 = UNPACKHI32 (t5, t7);                                                  \
+        r[0] = UNPACKLO64 (u0, u4);                                                                            \
+        r[1] = UNPACKHI64 (u0, u4);                                                                            \
+        r[2] = UNPACKLO64 (u1, u5);                                                                            \
+        r[3] = UNPACKHI64 (u1, u5);                                                                            \
+        r[4] = UNPACKLO64 (u2, u6);                                                                            \
+        r[5] = UNPACKHI64 (u2, u6);                                                                            \
+        r[6] = UNPACKLO64 (u3, u7);                                                                            \
+        r[7] = UNPACKHI64 (u3, u7);                                                                            \
+    }
+
+/** 8 frames x 8 channels starting at (frame, channel); F is INT16_LE or INT16_BE */
+template <PacketSampleFormat F>
+static inline void decodeBlockSSE2 (const SampleFrame* frames,
+                                    int frame,
+                                    int channel,
+                                    const float* gains,
+                                    const float* offsets,
+                                    float* dest,
+                                    int destStride)
+{
+    __m128i r[8];
+
+    for (int k = 0; k < 8; k++)
+    {
+        r[k] = _mm_loadu_si128 ((const __m128i*) (frames[frame + k].samples + channel * sizeof (int16_t)));
+
+        if constexpr (F == PacketSampleFormat::INT16_BE)
+            r[k] = _mm_or_si128 (_mm_slli_epi16 (r[k], 8), _mm_srli_epi16 (r[k], 8));
+    }
+
+    SAMPLEDECODER_TRANSPOSE8 (__m128i, _mm_unpacklo_epi16, _mm_unpackhi_epi16, _mm_unpacklo_epi32, _mm_unpackhi_epi32, _mm_unpacklo_epi64, _mm_unpackhi_epi64, r);
+
+    for (int c = 0; c < 8; c++)
+    {
+        // Sign-extend by placing each int16 in the top half of an int32
+        __m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (r[c], r[c]), 16);
+        __m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (r[c], r[c]), 16);
+
+        const __m128 gain = _mm_set1_ps (gains[channel + c]);
+        const __m128 offset = _mm_set1_ps (offsets[channel + c]);
+
+        float* out = dest + (size_t) (channel + c) * destStride + frame;
+        _mm_storeu_ps (out, _mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (lo), gain), offset));
+        _mm_storeu_ps (out + 4, _mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (hi), gain), offset));
+    }
+}
+
+template <PacketSampleFormat F>
+static void decodeSSE2 (const SampleFrame* frames,
+                        int numFrames,
+                        int numChannels,
+                        const float* gains,
+                        const float* offsets,
+                        float* dest,
+                        int destStride)
+{
+    const int vectorFrames = numFrames & ~7;
+    const int vectorChannels = numChannels & ~7;
+
+    // Channel blocks outermost so each pass writes 8 sequential output rows
+    for (int ch = 0; ch < vectorChannels; ch += 8)
+    {
+        for (int i = 0; i < vectorFrames; i += 8)
+            decodeBlockSSE2<F> (frames, i, ch, gains, offsets, dest, destStride);
+    }
+
+    decodeRange<F> (frames, 0, vectorFrames, vectorChannels, numChannels, gains, offsets, dest, destStride);
+    decodeRange<F> (frames, vectorFrames, numFrames, 0, numChannels, gains, offsets, dest, destStride);
+}
+
+template <PacketSampleFormat F>
+__attribute__ ((target ("avx2"))) static void decodeAVX2 (const SampleFrame* frames,
+                                                          int numFrames,
+                                                          int numChannels,
+                                                          const float* gains,
+                                                          const float* offsets,
+                                                          float* dest,
+                                                          int destStride)
+{
+    const int wideFrames = numFrames & ~15;
+    const int vectorFrames = numFrames & ~7;
+    const int vectorChannels = numChannels & ~7;
+
+    for (int ch = 0; ch < vectorChannels; ch += 8)
+    {
+        // 16 frames x 8 channels: lane 0 holds frames i..i+7, lane 1 frames i+8..i+15,
+        // so after the in-lane transpose each register is one channel across 16 frames
+        for (int i = 0; i < wideFrames; i += 16)
+        {
+            __m256i r[8];
+
+            for (int k = 0; k < 8; k++)
+            {
+                r[k] = _mm256_loadu2_m128i ((const __m128i*) (frames[i + 8 + k].samples + ch * sizeof (int16_t)),
+                                            (const __m128i*) (frames[i + k].samples + ch * sizeof (int16_t)));
+
+                if constexpr (F == PacketSampleFormat::INT16_BE)
+                    r[k] = _mm256_or_si256 (_mm256_slli_epi16 (r[k], 8), _mm256_srli_epi16 (r[k], 8));
+            }
+
+            SAMPLEDECODER_TRANSPOSE8 (__m256i, _mm256_unpacklo_epi16, _mm256_unpackhi_epi16, _mm256_unpacklo_epi32, _mm256_unpackhi_epi32, _mm256_unpacklo_epi64, _mm256_unpackhi_epi64, r);
+
+            for (int c = 0; c < 8; c++)
+            {
+                // Reorder quads to [i..i+3, i+8..i+11 | i+4..i+7, i+12..i+15] so the
+                // in-lane unpacks below yield frames in order
+                __m256i v = _mm256_permute4x64_epi64 (r[c], 0xD8);
+                __m256i lo = _mm256_srai_epi32 (_mm256_unpacklo_epi16 (v, v), 16);
+                __m256i hi = _mm256_srai_epi32 (_mm256_unpackhi_epi16 (v, v), 16);
+
+                const __m256 gain = _mm256_set1_ps (gains[ch + c]);
+                const __m256 offset = _mm256_set1_ps (offsets[ch + c]);
+
+                float* out = dest + (size_t) (ch + c) * destStride + i;
+                _mm256_storeu_ps (out, _mm256_add_ps (_mm256_mul_ps (_mm256_cvtepi32_ps (lo), gain), offset));
+                _mm256_storeu_ps (out + 8, _mm256_add_ps (_mm256_mul_ps (_mm256_cvtepi32_ps (hi), gain), offset));
+            }
+        }
+
+        if (wideFrames < vectorFrames)
+            decodeBlockSSE2<F> (frames, wideFrames, ch, gains, offsets, dest, destStride);
+    }
+
+    decodeRange<F> (frames, 0, vectorFrames, vectorChannels, numChannels, gains, offsets, dest, destStride);
+    decodeRange<F> (frames, vectorFrames, numFrames, 0, numChannels, gains, offsets, dest, destStride);
+}
+
+/** Kernel for the 4-byte formats: 4 frames x 4 channels at a time, byte-swapped and converted in registers */
+template <PacketSampleFormat F>
+static void decodeWideSSE2 (const SampleFrame* frames,
+                            int numFrames,
+                            int numChannels,
+                            const float* gains,
+                            const float* offsets,
+                            float* dest,
+                            int destStride)
+{
+    constexpr bool bigEndian = ((uint8_t) F & 1) != 0;
+    constexpr bool isFloat = F == PacketSampleFormat::FLOAT32_LE || F == PacketSampleFormat::FLOAT32_BE;
+
+    const __m128i lowBytes = _mm_set1_epi32 (0x00ff00ff);
+    const int vectorFrames = numFrames & ~3;
+    const int vectorChannels = numChannels & ~3;
+
+    for (int ch = 0; ch < vectorChannels; ch += 4)
+    {
+        for (int i = 0; i < vectorFrames; i += 4)
+        {
+            __m128 r[4];
+
+            for (int k = 0; k < 4; k++)
+            {
+                __m128i v = _mm_loadu_si128 ((const __m128i*) (frames[i + k].samples + ch * sizeof (int32_t)));
+
+                if constexpr (bigEndian)
+                {
+                    // Swap the bytes of each 16-bit half, then the halves
+                    v = _mm_or_si128 (_mm_slli_epi16 (v, 8), _mm_and_si128 (_mm_srli_epi16 (v, 8), lowBytes));
+                    v = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (v, 0xB1), 0xB1);
+                }
+
+                if constexpr (isFloat)
+                    r[k] = _mm_castsi128_ps (v);
+                else
+                    r[k] = _mm_cvtepi32_ps (v);
+            }
+
+            _MM_TRANSPOSE4_PS (r[0], r[1], r[2], r[3]);
+
+            for (int c = 0; c < 4; c++)
+            {
+                const __m128 gain = _mm_set1_ps (gains[ch + c]);
+                const __m128 offset = _mm_set1_ps (offsets[ch + c]);
+
+                _mm_storeu_ps (dest + (size_t) (ch + c) * destStride + i, _mm_add_ps (_mm_mul_ps (r[c], gain), offset));
+            }
+        }
+    }
+
+    decodeRange<F> (frames, 0, vectorFrames, vectorChannels, numChannels, gains, offsets, dest, destStride);
+    decodeRange<F> (frames, vectorFrames, numFrames, 0, numChannels, gains, offsets, dest, destStride);
+}
+
+#endif
+
+Kernel getBestKernel()
+{
+#ifdef SAMPLEDECODER_X86
+    if (__builtin_cpu_supports ("avx2"))
+        return Kernel::AVX2;
+
+    return Kernel::SSE2;
+#else
+    return Kernel::SCALAR;
+#endif
+}
+
+DecodeFunction getKernel (Kernel kernel)
+{
+    switch (kernel)
+    {
+        case Kernel::SCALAR:
+            return decodeFormat<PacketSampleFormat::INT16_LE>;
+#ifdef SAMPLEDECODER_X86
+        case Kernel::SSE2:
+            return decodeSSE2<PacketSampleFormat::INT16_LE>;
+        case Kernel::AVX2:
+            return __builtin_cpu_supports ("avx2") ? decodeAVX2<PacketSampleFormat::INT16_LE> : nullptr;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+const char* getKernelName (Kernel kernel)
+{
+    switch (kernel)
+    {
+        case Kernel::SCALAR:
+            return "scalar";
+        case Kernel::SSE2:
+            return "sse2";
+        case Kernel::AVX2:
+            return "avx2";
+    }
+
+    return "unknown";
+}
+
+DecodeFunction getFormatKernel (uint8_t format)
+{
+    switch ((PacketSampleFormat) format)
+    {
+        case PacketSampleFormat::INT16_LE:
+            return getKernel (getBestKernel());
+#ifdef SAMPLEDECODER_X86
+        case PacketSampleFormat::INT16_BE:
+            return getBestKernel() == Kernel::AVX2 ? decodeAVX2<PacketSampleFormat::INT16_BE>
+                                                   : decodeSSE2<PacketSampleFormat::INT16_BE>;
+        case PacketSampleFormat::INT32_LE:
+            return decodeWideSSE2<PacketSampleFormat::INT32_LE>;
+        case PacketSampleFormat::INT32_BE:
+            return decodeWideSSE2<PacketSampleFormat::INT32_BE>;
+        case PacketSampleFormat::FLOAT32_LE:
+            return decodeWideSSE2<PacketSampleFormat::FLOAT32_LE>;
+        case PacketSampleFormat::FLOAT32_BE:
+            return decodeWideSSE2<PacketSampleFormat::FLOAT32_BE>;
+#else
+        case PacketSampleFormat::INT16_BE:
+            return decodeFormat<PacketSampleFormat::INT16_BE>;
+        case PacketSampleFormat::INT32_LE:
+            return decodeFormat<PacketSampleFormat::INT32_LE>;
+        case PacketSampleFormat::INT32_BE:
+            return decodeFormat<PacketSampleFormat::INT32_BE>;
+        case PacketSampleFormat::FLOAT32_LE:
+            return decodeFormat<PacketSampleFormat::FLOAT32_LE>;
+        case PacketSampleFormat::FLOAT32_BE:
+            return decodeFormat<PacketSampleFormat::FLOAT32_BE>;
+#endif
+        // Packed 3-byte samples do not line up with vector lanes
+        case PacketSampleFormat::INT24_LE:
+            return decodeFormat<PacketSampleFormat::INT24_LE>;
+        case PacketSampleFormat::INT24_BE:
+            return decodeFormat<PacketSampleFormat::INT24_BE>;
+    }
+
+    return nullptr;
+}
+
+void decode (const SampleFrame* frames,
+             int numFrames,
+             int numChannels,
+             uint8_t format,
+             const float* gains,
+             const float* offsets,
+             float* dest,
+             int destStride)
+{
+    static const std::array<DecodeFunction, NUM_SAMPLE_FORMATS> kernels = []
+    {
+        std::array<DecodeFunction, NUM_SAMPLE_FORMATS> table;
+
+        for (int f = 0; f < NUM_SAMPLE_FORMATS; f++)
+            table[f] = getFormatKernel ((uint8_t) f);
+
+        return table;
+    }();
+
+    // Frames only reach the queue with a format that passed validation
+    if (format < NUM_SAMPLE_FORMATS)
+        kernels[format] (frames, numFrames, numChannels, gains, offsets, dest, destStride);
+}
+
+}
@@ -0,0 +1,87 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef SAMPLEDECODER_H_DEFINED
+#define SAMPLEDECODER_H_DEFINED
+
+#include "SampleFrame.h"
+
+/**
+    Converts queued sample frames (frame-major, in their wire format) into the
+    channel-major float layout expected by DataBuffer::addToBuffer, applying
+    each channel's calibration (gain, then offset) in the same pass.
+
+    Each sample format has its own kernel, specialised at compile time so the
+    inner loops never look at the format. For int16 little-endian, the common
+    case, vectorised kernels are compiled for every instruction set we know
+    about; the fastest one supported by the running CPU is selected on first use.
+*/
+namespace SampleDecoder
+{
+    /** Instruction sets of the int16 little-endian kernels */
+    enum class Kernel
+    {
+        SCALAR,
+        SSE2,
+        AVX2
+    };
+
+    /**
+        Signature shared by all kernels: writes
+        dest[channel * destStride + frame] = sample * gains[channel] + offsets[channel]
+    */
+    typedef void (*DecodeFunction) (const SampleFrame* frames,
+                                    int numFrames,
+                                    int numChannels,
+                                    const float* gains,
+                                    const float* offsets,
+                                    float* dest,
+                                    int destStride);
+
+    /** Returns the fastest int16 little-endian kernel supported by this CPU */
+    Kernel getBestKernel();
+
+    /** Returns the given int16 little-endian kernel, or nullptr if this CPU or build cannot run it */
+    DecodeFunction getKernel (Kernel kernel);
+
+    /** Returns a short display name for a kernel */
+    const char* getKernelName (Kernel kernel);
+
+    /**
+        Returns the kernel for frames in the given PacketSampleFormat, the best
+        available one for int16 little-endian, or nullptr for an unknown format
+    */
+    DecodeFunction getFormatKernel (uint8_t format);
+
+    /** Decodes numFrames contiguous frames, all in the given format, with the best available kernel */
+    void decode (const SampleFrame* frames,
+                 int numFrames,
+                 int numChannels,
+                 uint8_t format,
+                 const float* gains,
+                 const float* offsets,
+                 float* dest,
+                 int destStride);
+}
+
+#endif
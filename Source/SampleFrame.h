@@ -0,0 +1,56 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef SAMPLEFRAME_H_DEFINED
+#define SAMPLEFRAME_H_DEFINED
+
+#include <cstdint>
+
+#include "PacketHeader.h"
+#include "SpscRingBuffer.h"
+
+/** Upper bound on the number of channels carried by one sample frame */
+constexpr int MAX_DATA_CHANNELS = 128;
+
+/** Frames the receiver can queue ahead of the acquisition thread (~270 ms at 30 kHz) */
+constexpr size_t FRAME_QUEUE_CAPACITY = 8192;
+
+/**
+    One sample across all channels, as received on the wire, tagged with
+    its position in its sender's stream. samples holds the configured number of
+    channels, each encoded in format exactly as it arrived; conversion is
+    left to the consumer (see SampleDecoder).
+*/
+struct SampleFrame
+{
+    int64_t sampleNumber;
+    double timestamp; // seconds, derived from the kernel receive time
+    uint8_t format;   // PacketSampleFormat of samples
+    uint8_t stream;   // sender stream the frame belongs to (see SenderStreams)
+    alignas (16) unsigned char samples[MAX_DATA_CHANNELS * MAX_SAMPLE_SIZE];
+};
+
+/** Queue carrying frames from the UDP receiver thread to updateBuffer() */
+typedef SpscRingBuffer<SampleFrame> SampleFrameQueue;
+
+#endif
@@ -0,0 +1,260 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include "SenderStreams.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+bool SenderAddress::operator== (const SenderAddress& other) const
+{
+    return port == other.port && memcmp (address, other.address, sizeof (address)) == 0;
+}
+
+uint32_t SenderAddress::hash() const
+{
+    uint32_t h = 2166136261u;
+
+    for (uint8_t byte : address)
+        h = (h ^ byte) * 16777619u;
+
+    h = (h ^ (port & 0xff)) * 16777619u;
+    return (h ^ (port >> 8)) * 16777619u;
+}
+
+bool SenderAddress::fromSockaddr (const void* name, size_t length, SenderAddress& sender)
+{
+    sockaddr_storage storage {};
+    memcpy (&storage, name, std::min (length, sizeof (storage)));
+
+    if (storage.ss_family == AF_INET && length >= sizeof (sockaddr_in))
+    {
+        const sockaddr_in& in = reinterpret_cast<const sockaddr_in&> (storage);
+        sender = fromBytes (reinterpret_cast<const unsigned char*> (&in.sin_addr), 4, ntohs (in.sin_port));
+        return true;
+    }
+
+    if (storage.ss_family == AF_INET6 && length >= sizeof (sockaddr_in6))
+    {
+        const sockaddr_in6& in6 = reinterpret_cast<const sockaddr_in6&> (storage);
+        sender = fromBytes (in6.sin6_addr.s6_addr, 16, ntohs (in6.sin6_port));
+        return true;
+    }
+
+    return false;
+}
+
+SenderAddress SenderAddress::fromBytes (const unsigned char* bytes, size_t length, uint16_t port)
+{
+    SenderAddress sender;
+    sender.port = port;
+
+    if (length == 4)
+    {
+        // ::ffff:a.b.c.d, as a dual-stack socket reports IPv4 senders
+        sender.address[10] = 0xff;
+        sender.address[11] = 0xff;
+        memcpy (sender.address + 12, bytes, 4);
+    }
+    else
+    {
+        memcpy (sender.address, bytes, std::min (length, sizeof (sender.address)));
+    }
+
+    return sender;
+}
+
+std::string SenderAddress::toString() const
+{
+    char text[INET6_ADDRSTRLEN];
+    const in6_addr* v6 = reinterpret_cast<const in6_addr*> (address);
+
+    if (IN6_IS_ADDR_V4MAPPED (v6))
+    {
+        inet_ntop (AF_INET, address + 12, text, sizeof (text));
+        return std::string (text) + ":" + std::to_string (port);
+    }
+
+    inet_ntop (AF_INET6, address, text, sizeof (text));
+    return "[" + std::string (text) + "]:" + std::to_string (port);
+}
+
+// ------------------------------------------------------------
+
+bool SenderStreams::parseSenders (const std::string& text, int numStreams, std::vector<std::pair<SenderAddress, bool>>& senders, std::string& error)
+{
+    senders.clear();
+    size_t position = 0;
+
+    while (position < text.size())
+    {
+        const size_t end = std::min (text.find_first_of (", \t", position), text.size());
+        const std::string entry = text.substr (position, end - position);
+        position = end + 1;
+
+        if (entry.empty())
+            continue;
+
+        // [v6]:port, [v6], v4:port, v4 or a bare v6 address
+        std::string host = entry;
+        std::string port;
+
+        if (entry[0] == '[')
+        {
+            const size_t close = entry.find (']');
+            if (close == std::string::npos || (close + 1 < entry.size() && entry[close + 1] != ':'))
+            {
+                error = "cannot read sender " + entry;
+                return false;
+            }
+
+            host = entry.substr (1, close - 1);
+            if (close + 1 < entry.size())
+                port = entry.substr (close + 2);
+        }
+        else if (entry.find (':') == entry.rfind (':') && entry.find (':') != std::string::npos)
+        {
+            host = entry.substr (0, entry.find (':'));
+            port = entry.substr (entry.find (':') + 1);
+        }
+
+        unsigned char bytes[16];
+        size_t length = 0;
+
+        if (inet_pton (AF_INET, host.c_str(), bytes) == 1)
+            length = 4;
+        else if (inet_pton (AF_INET6, host.c_str(), bytes) == 1)
+            length = 16;
+
+        char* portEnd = nullptr;
+        const long portNumber = port.empty() ? 0 : std::strtol (port.c_str(), &portEnd, 10);
+
+        if (length == 0 || (! port.empty() && (*portEnd != '\0' || portNumber < 1 || portNumber > 65535)))
+        {
+            error = "cannot read sender " + entry + " (expected an address, optionally with :port)";
+            return false;
+        }
+
+        senders.emplace_back (SenderAddress::fromBytes (bytes, length, (uint16_t) portNumber), port.empty());
+    }
+
+    if ((int) senders.size() > numStreams)
+    {
+        error = std::to_string (senders.size()) + " senders listed for " + std::to_string (numStreams) + " streams";
+        return false;
+    }
+
+    return true;
+}
+
+bool SenderStreams::configure (int numStreams_, const std::string& senders, std::string& error)
+{
+    std::lock_guard<std::mutex> guard (lock);
+
+    numStreams = std::clamp (numStreams_, 1, MAX_STREAMS);
+    fixed.clear();
+    taken.fill (false);
+
+    std::vector<std::pair<SenderAddress, bool>> parsed;
+    if (! parseSenders (senders, numStreams, parsed, error))
+        return false;
+
+    for (size_t s = 0; s < parsed.size(); s++)
+    {
+        fixed.push_back ({ parsed[s].first, parsed[s].second, (int) s });
+        taken[s] = true;
+    }
+
+    return true;
+}
+
+int SenderStreams::assign (const SenderAddress& sender, bool& assigned)
+{
+    assigned = false;
+
+    for (const FixedSender& entry : fixed)
+    {
+        if (memcmp (entry.sender.address, sender.address, sizeof (sender.address)) == 0
+            && (entry.anyPort || entry.sender.port == sender.port))
+            return entry.stream;
+    }
+
+    // Streams after the fixed ones go to senders in order of arrival
+    std::lock_guard<std::mutex> guard (lock);
+
+    for (int s = (int) fixed.size(); s < numStreams; s++)
+    {
+        if (taken[s] && dynamic[s] == sender)
+            return s;
+    }
+
+    for (int s = (int) fixed.size(); s < numStreams; s++)
+    {
+        if (! taken[s])
+        {
+            taken[s] = true;
+            dynamic[s] = sender;
+            assigned = true;
+            return s;
+        }
+    }
+
+    return NO_STREAM;
+}
+
+// ------------------------------------------------------------
+
+void SenderCache::clear()
+{
+    slots.fill (Slot());
+    used = 0;
+}
+
+int SenderCache::lookup (const SenderAddress& sender, SenderStreams& streams, bool& assigned)
+{
+    assigned = false;
+    size_t index = sender.hash() & (SIZE - 1);
+
+    for (; slots[index].used; index = (index + 1) & (SIZE - 1))
+    {
+        if (slots[index].sender == sender)
+            return slots[index].stream;
+    }
+
+    const int stream = streams.assign (sender, assigned);
+
+    // Keeping the table at most half full keeps probe sequences short
+    if (used < SIZE / 2)
+    {
+        slots[index].sender = sender;
+        slots[index].stream = stream;
+        slots[index].used = true;
+        used++;
+    }
+
+    return stream;
+}
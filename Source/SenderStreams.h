@@ -0,0 +1,139 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef SENDERSTREAMS_H_DEFINED
+#define SENDERSTREAMS_H_DEFINED
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** A sender's IP address and UDP port; IPv4 addresses are kept IPv4-mapped, so both families compare alike */
+struct SenderAddress
+{
+    uint8_t address[16] = {};
+    uint16_t port = 0;
+
+    bool operator== (const SenderAddress& other) const;
+
+    /** FNV-1a over address and port */
+    uint32_t hash() const;
+
+    /** Takes the address of a sockaddr_in or sockaddr_in6; returns false for other families */
+    static bool fromSockaddr (const void* name, size_t length, SenderAddress& sender);
+
+    /** Takes an IPv4 (4 bytes) or IPv6 (16 bytes) address and a port, as found in packet headers */
+    static SenderAddress fromBytes (const unsigned char* address, size_t length, uint16_t port);
+
+    /** "10.0.0.5:5000" or "[fe80::1]:5000" */
+    std::string toString() const;
+};
+
+/**
+    Decides which stream each sender's packets go to, for receivers that
+    demultiplex one port into several streams.
+
+    Streams can be tied to senders in advance, by address and optionally
+    port; the remaining ones are handed out to unknown senders in order of
+    arrival. Senders that find no stream are discarded. Shared by all
+    receiver threads, which look senders up through a SenderCache so that the
+    lock is only taken the first time a sender is seen.
+*/
+class SenderStreams
+{
+public:
+    static constexpr int MAX_STREAMS = 8;
+    static constexpr int NO_STREAM = -1;
+
+    /**
+        Parses a list of senders, separated by commas or spaces, where the
+        n-th one feeds stream n: "10.0.0.5, 10.0.0.6:5000, [fe80::1]:5000".
+        Without a port, any port of the address matches. Returns false, with
+        error set, if an entry is not a numeric address or there are more
+        than numStreams of them.
+    */
+    static bool parseSenders (const std::string& text, int numStreams, std::vector<std::pair<SenderAddress, bool>>& senders, std::string& error);
+
+    /** Sets the number of streams and the senders tied to them; forgets all other senders. Only while no receiver runs. */
+    bool configure (int numStreams, const std::string& senders, std::string& error);
+
+    int getNumStreams() const { return numStreams; }
+
+    /** False when every packet goes to stream 0, so senders need not be looked up at all */
+    bool isRouting() const { return numStreams > 1 || ! fixed.empty(); }
+
+    /**
+        Returns the stream of a sender, giving a new sender the first stream
+        nobody has yet, or NO_STREAM. assigned is set if the sender was just
+        given its stream. Thread safe.
+    */
+    int assign (const SenderAddress& sender, bool& assigned);
+
+private:
+    struct FixedSender
+    {
+        SenderAddress sender;
+        bool anyPort;
+        int stream;
+    };
+
+    int numStreams = 1;
+    std::vector<FixedSender> fixed;
+
+    std::mutex lock;
+    std::array<SenderAddress, MAX_STREAMS> dynamic; // senders of the streams after the fixed ones
+    std::array<bool, MAX_STREAMS> taken {};         // stream has a sender
+};
+
+/**
+    One receiver thread's memory of which stream its senders go to: a small
+    open-addressing hash table in front of SenderStreams::assign(). Senders
+    without a stream are remembered too, so a stray sender costs a lookup
+    rather than a lock per packet.
+*/
+class SenderCache
+{
+public:
+    void clear();
+
+    /** Returns the stream of sender (or NO_STREAM); assigned is set if the sender was just given a stream */
+    int lookup (const SenderAddress& sender, SenderStreams& streams, bool& assigned);
+
+private:
+    static constexpr size_t SIZE = 64; // power of two; once half full, new senders are not cached
+
+    struct Slot
+    {
+        SenderAddress sender;
+        int stream = SenderStreams::NO_STREAM;
+        bool used = false;
+    };
+
+    std::array<Slot, SIZE> slots;
+    size_t used = 0;
+};
+
+#endif
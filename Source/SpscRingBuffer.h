@@ -0,0 +1,150 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef SPSCRINGBUFFER_H_DEFINED
+#define SPSCRINGBUFFER_H_DEFINED
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/**
+    Lock-free single-producer / single-consumer ring of fixed-size slots.
+
+    The producer fills slots in place with writeSlot() and makes them visible
+    with publish(); the consumer reads them in place with readSlot() and hands
+    them back with release(). Head and tail live on separate cache lines and are
+    only ever synchronised with acquire/release, so neither side blocks or
+    contends with the other.
+*/
+template <typename T>
+class SpscRingBuffer
+{
+public:
+    /** Creates a ring that holds at least minCapacity elements (rounded up to a power of two) */
+    explicit SpscRingBuffer (size_t minCapacity)
+    {
+        size_t capacity = 1;
+        while (capacity < minCapacity)
+            capacity <<= 1;
+
+        mask = capacity - 1;
+        slots.reset (new T[capacity]);
+    }
+
+    /** Returns the total number of slots */
+    size_t capacity() const { return mask + 1; }
+
+    // ------------------------------------------------------------
+    //                  PRODUCER THREAD ONLY
+    // ------------------------------------------------------------
+
+    /**
+        Returns the number of slots the producer may fill before publishing.
+        The consumer's position is only re-read when fewer than wanted slots
+        appear to be free, so most calls stay on the producer's cache line.
+    */
+    size_t writeAvailable (size_t wanted = 1)
+    {
+        const size_t h = head.load (std::memory_order_relaxed);
+
+        if (capacity() - (h - producerTail) < wanted)
+            producerTail = tail.load (std::memory_order_acquire);
+
+        return capacity() - (h - producerTail);
+    }
+
+    /** Returns the index-th unpublished slot (index must be below writeAvailable()) */
+    T& writeSlot (size_t index)
+    {
+        return slots[(head.load (std::memory_order_relaxed) + index) & mask];
+    }
+
+    /** Returns how many of count writable slots, starting at writeSlot (index), are contiguous in memory */
+    size_t contiguousWritable (size_t count, size_t index = 0) const
+    {
+        const size_t offset = (head.load (std::memory_order_relaxed) + index) & mask;
+        return count < capacity() - offset ? count : capacity() - offset;
+    }
+
+    /** Makes the next count filled slots visible to the consumer */
+    void publish (size_t count)
+    {
+        head.store (head.load (std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    // ------------------------------------------------------------
+    //                  CONSUMER THREAD ONLY
+    // ------------------------------------------------------------
+
+    /** Returns the number of published slots waiting to be read */
+    size_t readAvailable()
+    {
+        return head.load (std::memory_order_acquire) - tail.load (std::memory_order_relaxed);
+    }
+
+    /** Returns the index-th published slot (index must be below readAvailable()) */
+    const T& readSlot (size_t index) const
+    {
+        return slots[(tail.load (std::memory_order_relaxed) + index) & mask];
+    }
+
+    /** Returns how many of count readable slots, starting at readSlot (index), are contiguous in memory */
+    size_t contiguousReadable (size_t count, size_t index = 0) const
+    {
+        const size_t offset = (tail.load (std::memory_order_relaxed) + index) & mask;
+        return count < capacity() - offset ? count : capacity() - offset;
+    }
+
+    /** Hands the next count read slots back to the producer */
+    void release (size_t count)
+    {
+        tail.store (tail.load (std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    // ------------------------------------------------------------
+
+    /** Empties the ring. Only safe while neither side is running. */
+    void reset()
+    {
+        head.store (0, std::memory_order_relaxed);
+        tail.store (0, std::memory_order_relaxed);
+        producerTail = 0;
+    }
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    /** Written by the producer, read by the consumer */
+    alignas (CACHE_LINE) std::atomic<size_t> head { 0 };
+    /** Producer's last observed tail, so it only touches the consumer's line when full */
+    size_t producerTail = 0;
+
+    /** Written by the consumer, read by the producer */
+    alignas (CACHE_LINE) std::atomic<size_t> tail { 0 };
+
+    alignas (CACHE_LINE) size_t mask = 0;
+    std::unique_ptr<T[]> slots;
+};
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include "ThreadScheduling.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+
+ThreadScheduling applyThreadScheduling (const ThreadScheduling& requested)
+{
+    ThreadScheduling achieved;
+    const pthread_t self = pthread_self();
+
+    if (requested.cpu >= 0 && requested.cpu < CPU_SETSIZE)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO (&cpus);
+        CPU_SET (requested.cpu, &cpus);
+
+        if (pthread_setaffinity_np (self, sizeof (cpus), &cpus) == 0)
+            achieved.cpu = requested.cpu;
+    }
+
+    if (requested.priority > 0)
+    {
+        sched_param param {};
+        param.sched_priority = std::clamp (requested.priority,
+                                           sched_get_priority_min (SCHED_FIFO),
+                                           sched_get_priority_max (SCHED_FIFO));
+
+        // Fails with EPERM without the privilege; the thread is then left as it was
+        pthread_setschedparam (self, SCHED_FIFO, &param);
+    }
+
+    // Report what the kernel holds rather than what was asked for
+    int policy = SCHED_OTHER;
+    sched_param current {};
+    if (pthread_getschedparam (self, &policy, &current) == 0 && policy == SCHED_FIFO)
+        achieved.priority = current.sched_priority;
+
+    return achieved;
+}
+
+std::string describeThreadScheduling (const ThreadScheduling& scheduling)
+{
+    std::string description = scheduling.priority > 0 ? "FIFO " + std::to_string (scheduling.priority) : "normal";
+
+    if (scheduling.cpu >= 0)
+        description += ", core " + std::to_string (scheduling.cpu);
+
+    return description;
+}
@@ -0,0 +1,52 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef THREADSCHEDULING_H_DEFINED
+#define THREADSCHEDULING_H_DEFINED
+
+#include <string>
+
+/**
+    Where a thread runs and at what priority. Both parts are optional: an
+    unpinned thread may run on any core the process is allowed, and one
+    without a priority stays under the normal time-sharing policy.
+*/
+struct ThreadScheduling
+{
+    int cpu = -1;     // core the thread is pinned to, -1 for any
+    int priority = 0; // SCHED_FIFO priority (1-99), 0 for SCHED_OTHER
+};
+
+/**
+    Applies as much of requested as it can to the calling thread and returns
+    what the thread actually got. Without the privilege for real-time
+    scheduling (CAP_SYS_NICE, or an rtprio limit in limits.conf) the thread
+    keeps its normal policy; a core that does not exist or is outside the
+    process's affinity mask leaves it unpinned.
+*/
+ThreadScheduling applyThreadScheduling (const ThreadScheduling& requested);
+
+/** Describes scheduling for the log or the editor, e.g. "FIFO 50, core 3" */
+std::string describeThreadScheduling (const ThreadScheduling& scheduling);
+
+#endif
@@ -0,0 +1,1501 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include "UdpReceiver.h"
+
+#include "CaptureReader.h"
+#include "IoUring.h"
+#include "PacketHeader.h"
+#include "SampleDecoder.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <string>
+
+static int setNonblocking (int fd)
+{
+    int flags = fcntl (fd, F_GETFL, 0);
+    if (flags == -1)
+        return -1;
+    return fcntl (fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/**
+    Resolves what a receiver socket binds to: the multicast group if there is
+    one, otherwise the bind address. An empty bind address is any IPv4 address,
+    "::" any IPv4 or IPv6 address. Addresses are numeric; IPv6 link-local ones
+    take their interface as a scope, e.g. "fe80::1%eth1".
+*/
+static bool getBindAddress (const UdpReceiver::Settings& settings, int port, sockaddr_storage& address, socklen_t& length)
+{
+    const std::string& host = settings.multicastGroup.empty() ? settings.bindAddress : settings.multicastGroup;
+
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV | AI_PASSIVE;
+
+    addrinfo* result = nullptr;
+    const int error = getaddrinfo (host.empty() ? "0.0.0.0" : host.c_str(), std::to_string (port).c_str(), &hints, &result);
+
+    if (error != 0)
+    {
+        LOGC ("Cannot bind to ", host, ": ", gai_strerror (error));
+        return false;
+    }
+
+    memcpy (&address, result->ai_addr, result->ai_addrlen);
+    length = result->ai_addrlen;
+    freeaddrinfo (result);
+
+    return true;
+}
+
+/**
+    Subscribes sock to the multicast group it is bound to, on the given
+    interface; an empty interface lets the routing table choose. IPv4
+    interfaces may be given by address or name, IPv6 ones by name only.
+*/
+static bool joinMulticastGroup (int sock, const sockaddr_storage& group, const std::string& interface)
+{
+    // Only datagrams of groups this socket joined, not those of every socket on the host
+    int no = 0;
+    int result;
+
+    if (group.ss_family == AF_INET)
+    {
+        ip_mreqn request {};
+        request.imr_multiaddr = reinterpret_cast<const sockaddr_in&> (group).sin_addr;
+
+        if (! IN_MULTICAST (ntohl (request.imr_multiaddr.s_addr)))
+        {
+            LOGC ("Multicast group is not an IPv4 multicast address (224.0.0.0 to 239.255.255.255)");
+            return false;
+        }
+
+        if (! interface.empty() && inet_pton (AF_INET, interface.c_str(), &request.imr_address) != 1)
+        {
+            request.imr_ifindex = (int) if_nametoindex (interface.c_str());
+
+            if (request.imr_ifindex == 0)
+            {
+                LOGC ("Multicast interface ", interface, " not found");
+                return false;
+            }
+        }
+
+        setsockopt (sock, IPPROTO_IP, IP_MULTICAST_ALL, &no, sizeof (no));
+        result = setsockopt (sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof (request));
+    }
+    else
+    {
+        ipv6_mreq request {};
+        request.ipv6mr_multiaddr = reinterpret_cast<const sockaddr_in6&> (group).sin6_addr;
+
+        if (! IN6_IS_ADDR_MULTICAST (&request.ipv6mr_multiaddr))
+        {
+            LOGC ("Multicast group is not an IPv6 multicast address (ff00::/8)");
+            return false;
+        }
+
+        if (! interface.empty())
+        {
+            request.ipv6mr_interface = if_nametoindex (interface.c_str());
+
+            if (request.ipv6mr_interface == 0)
+            {
+                LOGC ("Multicast interface ", interface, " not found (IPv6 groups take an interface name)");
+                return false;
+            }
+        }
+
+#ifdef IPV6_MULTICAST_ALL
+        setsockopt (sock, IPPROTO_IPV6, IPV6_MULTICAST_ALL, &no, sizeof (no));
+#endif
+        result = setsockopt (sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, &request, sizeof (request));
+    }
+
+    if (result == -1)
+    {
+        LOGC ("Cannot join multicast group: ", strerror (errno));
+        return false;
+    }
+
+    return true;
+}
+
+/** Returns the current CLOCK_REALTIME time in nanoseconds, the clock SO_TIMESTAMPNS uses */
+static int64_t realtimeNowNs()
+{
+    timespec ts;
+    clock_gettime (CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/** Returns a one-shot timer setting that expires after the given number of microseconds */
+static itimerspec timerAfter (int microseconds)
+{
+    itimerspec timer {};
+    timer.it_value.tv_sec = microseconds / 1000000;
+    timer.it_value.tv_nsec = (microseconds % 1000000) * 1000L;
+    return timer;
+}
+
+// ------------------------------------------------------------
+
+ReceiverShard::Stream::Stream (ReceiverShard& shard_, int index_) : shard (shard_),
+                                                                   index (index_),
+                                                                   sequencer (*this)
+{
+}
+
+ReceiverShard::ReceiverShard() : queue (FRAME_QUEUE_CAPACITY)
+{
+    for (int s = 0; s < SenderStreams::MAX_STREAMS; s++)
+        streams[s] = std::make_unique<Stream> (*this, s);
+}
+
+void ReceiverShard::reset (int channels_, int numStreams_, int reorderWindow, PacketSequencer::GapPolicy gapPolicy, double samplePeriod)
+{
+    queue.reset();
+    droppedFrames = 0;
+    malformedPackets = 0;
+    kernelDrops = 0;
+    unroutedPackets = 0;
+    kernelDropsBase = 0;
+    channels = channels_;
+    framesPublished = 0;
+    flushThreshold = 1;
+    frameRate = 0;
+    rateWindowStartNs = 0;
+    rateWindowFrames = 0;
+    scheduling = ThreadScheduling();
+    senders.clear();
+
+    numStreams = std::clamp (numStreams_, 1, SenderStreams::MAX_STREAMS);
+
+    for (int s = 0; s < numStreams; s++)
+        streams[s]->sequencer.reset (reorderWindow, gapPolicy, 0, samplePeriod);
+}
+
+bool ReceiverShard::isHolding() const
+{
+    for (int s = 0; s < numStreams; s++)
+    {
+        if (streams[s]->sequencer.isHolding())
+            return true;
+    }
+
+    return false;
+}
+
+void ReceiverShard::flushExpired (int64_t nowNs, int64_t maxAgeNs)
+{
+    for (int s = 0; s < numStreams; s++)
+        streams[s]->sequencer.flushExpired (nowNs, maxAgeNs);
+}
+
+int64_t ReceiverShard::getLostPackets() const
+{
+    int64_t total = 0;
+
+    for (int s = 0; s < numStreams; s++)
+        total += streams[s]->sequencer.getLostPackets();
+
+    return total;
+}
+
+int64_t ReceiverShard::getLatePackets() const
+{
+    int64_t total = 0;
+
+    for (int s = 0; s < numStreams; s++)
+        total += streams[s]->sequencer.getLatePackets();
+
+    return total;
+}
+
+int64_t ReceiverShard::getDuplicatePackets() const
+{
+    int64_t total = 0;
+
+    for (int s = 0; s < numStreams; s++)
+        total += streams[s]->sequencer.getDuplicatePackets();
+
+    return total;
+}
+
+void ReceiverShard::writeFrames (const PacketSequencer::FrameRun& run, int stream)
+{
+    if ((int) queue.writeAvailable (run.numFrames) < run.numFrames)
+    {
+        // Acquisition thread has fallen behind; never block the socket
+        droppedFrames.fetch_add (run.numFrames, std::memory_order_relaxed);
+        return;
+    }
+
+    // Samples stay in their wire format; only the channel count is adjusted
+    const size_t sampleSize = getSampleSize (run.sampleFormat);
+    const size_t copied = std::min (run.channels, channels) * sampleSize;
+    const size_t frameBytes = channels * sampleSize;
+
+    for (int i = 0; i < run.numFrames; i++)
+    {
+        SampleFrame& frame = queue.writeSlot (i);
+
+        frame.sampleNumber = run.firstSampleNumber + i;
+        frame.timestamp = run.firstTimestamp + i * run.samplePeriod;
+        frame.format = run.sampleFormat;
+        frame.stream = (uint8_t) stream;
+        memcpy (frame.samples, run.samples + i * run.frameStride, copied);
+        memset (frame.samples + copied, 0, frameBytes - copied);
+    }
+
+    queue.publish (run.numFrames);
+    framesPublished += run.numFrames;
+}
+
+// ------------------------------------------------------------
+
+UdpReceiver::UdpReceiver()
+{
+    wakeupFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    stopFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+UdpReceiver::~UdpReceiver()
+{
+    stopThreads();
+
+    if (wakeupFd != -1)
+        close (wakeupFd);
+
+    if (stopFd != -1)
+        close (stopFd);
+}
+
+void UdpReceiver::start (const Settings& newSettings)
+{
+    stopThreads();
+
+    settings = newSettings;
+    settings.channels = std::clamp (settings.channels, 1, MAX_DATA_CHANNELS);
+    settings.batchSize = std::clamp (settings.batchSize, 1, MAX_RECV_BATCH);
+
+    // Every socket in a multicast group gets its own copy of each datagram, so
+    // SO_REUSEPORT cannot spread them over several receivers
+    if (! settings.multicastGroup.empty() && settings.source == SOURCE_NETWORK && settings.receivers > 1)
+    {
+        LOGC ("Multicast reception uses a single receiver");
+        settings.receivers = 1;
+    }
+
+    // Senders are assigned streams afresh; without a valid list none are tied to a stream
+    std::string error;
+    if (! senderStreams.configure (settings.streams, settings.streamSenders, error))
+    {
+        LOGC ("Stream senders: ", error);
+        senderStreams.configure (settings.streams, "", error);
+    }
+
+    // Receivers are stopped, so their queues and sequencing state can be reset from here
+    shards.resize (std::clamp (settings.receivers, 1, MAX_RECEIVERS));
+
+    for (size_t s = 0; s < shards.size(); s++)
+    {
+        auto& shard = shards[s];
+
+        if (shard == nullptr)
+            shard = std::make_unique<ReceiverShard>();
+
+        shard->index = (int) s;
+        shard->reset (settings.channels, senderStreams.getNumStreams(), settings.reorderWindow,
+                      (PacketSequencer::GapPolicy) settings.gapPolicy, 1.0 / settings.sampleRate);
+    }
+
+    mergedSampleNumbers.fill (0);
+
+    for (auto& numbers : lastSampleNumbers)
+        numbers.fill (-1);
+
+    startThreads();
+}
+
+void UdpReceiver::stop()
+{
+    stopThreads();
+}
+
+void UdpReceiver::setPort (int port)
+{
+    // A replay would start over, so it keeps the port it was started with
+    if (running && settings.source == SOURCE_REPLAY)
+        return;
+
+    // Receiver threads read settings, so it only changes once they have all exited
+    // (including any that left on their own, e.g. after a signal)
+    const bool restart = running;
+    stopThreads();
+    settings.port = port;
+
+    if (restart)
+        startThreads();
+}
+
+void UdpReceiver::startThreads()
+{
+    running = true;
+
+    if (settings.source == SOURCE_REPLAY)
+    {
+        threads.emplace_back (&UdpReceiver::replay, this);
+        return;
+    }
+
+    // One thread per shard, all bound to the same port
+    for (auto& shard : shards)
+        threads.emplace_back (&UdpReceiver::receive, this, std::ref (*shard));
+}
+
+void UdpReceiver::stopThreads()
+{
+    running = false;
+
+    if (threads.empty())
+        return;
+
+    // Every thread waits on stopFd along with its sockets and timers, so none
+    // has to wait for a packet to notice; it stays readable until all have left
+    const uint64_t one = 1;
+    ssize_t w = write (stopFd, &one, sizeof (one));
+    (void) w;
+
+    for (auto& thread : threads)
+        thread.join();
+
+    threads.clear();
+
+    uint64_t count;
+    ssize_t r = read (stopFd, &count, sizeof (count));
+    (void) r;
+}
+
+bool UdpReceiver::sleepUnlessStopped (int64_t ns)
+{
+    pollfd pfd {};
+    pfd.fd = stopFd;
+    pfd.events = POLLIN;
+
+    timespec timeout;
+    timeout.tv_sec = ns / 1000000000LL;
+    timeout.tv_nsec = ns % 1000000000LL;
+
+    return ppoll (&pfd, 1, &timeout, nullptr) == 0 && running;
+}
+
+ThreadScheduling UdpReceiver::scheduleThread (int index)
+{
+    ThreadScheduling requested;
+    requested.cpu = settings.receiverCpu >= 0 ? settings.receiverCpu + index : -1;
+    requested.priority = settings.receiverPriority;
+
+    const ThreadScheduling achieved = applyThreadScheduling (requested);
+
+    if (achieved.cpu != requested.cpu)
+        LOGC ("Receiver ", index, " cannot be pinned to core ", requested.cpu, ", it may run on any core");
+
+    if (achieved.priority < requested.priority)
+        LOGC ("Receiver ", index, " is not permitted SCHED_FIFO (needs CAP_SYS_NICE or an rtprio limit), running at normal priority");
+
+    return achieved;
+}
+
+void UdpReceiver::handleReceive (ReceiverShard& shard, const char* data, size_t length, const msghdr& hdr, int64_t fallbackNs)
+{
+    int64_t receivedNs = fallbackNs;
+    size_t segmentSize = length; // one datagram, unless GRO coalesced several
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR (&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR (const_cast<msghdr*> (&hdr), cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            timespec ts;
+            memcpy (&ts, CMSG_DATA (cmsg), sizeof (ts));
+            receivedNs = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        }
+        else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+        {
+            uint32_t drops;
+            memcpy (&drops, CMSG_DATA (cmsg), sizeof (drops));
+            shard.kernelDrops.store (shard.kernelDropsBase + drops, std::memory_order_relaxed);
+        }
+        else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+        {
+            int size;
+            memcpy (&size, CMSG_DATA (cmsg), sizeof (size));
+            if (size > 0)
+                segmentSize = (size_t) size;
+        }
+    }
+
+    // Coalesced datagrams share a sender, so one lookup routes them all
+    int stream = 0;
+
+    if (senderStreams.isRouting())
+    {
+        SenderAddress sender;
+        bool assigned = false;
+
+        stream = SenderAddress::fromSockaddr (hdr.msg_name, hdr.msg_namelen, sender)
+                     ? shard.senders.lookup (sender, senderStreams, assigned)
+                     : SenderStreams::NO_STREAM;
+
+        if (assigned)
+            LOGC ("Sender ", sender.toString(), " feeds stream ", stream + 1);
+    }
+
+    // Coalesced datagrams are all segmentSize long, except possibly the last
+    for (size_t offset = 0; offset < length; offset += segmentSize)
+    {
+        const size_t segment = std::min (segmentSize, length - offset);
+
+        if (recorder != nullptr)
+            recorder->record (shard.index, stream, data + offset, segment, receivedNs);
+
+        if (stream == SenderStreams::NO_STREAM)
+            shard.unroutedPackets.fetch_add (1, std::memory_order_relaxed);
+        else
+            pushDatagram (shard, stream, data + offset, segment, receivedNs * 1e-9);
+    }
+}
+
+void UdpReceiver::pushDatagram (ReceiverShard& shard, int stream, const char* data, size_t length, double received)
+{
+    PacketSequencer& sequencer = shard.getSequencer (stream);
+
+    const double samplePeriod = 1.0 / settings.sampleRate;
+
+    if (settings.protocol == PROTOCOL_RAW)
+    {
+        // One frame of whatever the format parameter says
+        const uint8_t format = (uint8_t) settings.sampleFormat;
+        sequencer.addUnsequenced (data, 1, (int) (length / getSampleSize (format)), format, received);
+        return;
+    }
+
+    PacketHeader header;
+    if (parsePacketHeader (data, length, header) != PacketStatus::OK)
+    {
+        shard.malformedPackets.fetch_add (1, std::memory_order_relaxed);
+        return;
+    }
+
+    const double firstTimestamp = received - (header.samplesPerPacket - 1) * samplePeriod;
+
+    sequencer.addPacket (header.sequence, data + header.headerSize, header.samplesPerPacket, header.channels,
+                         header.sampleFormat, firstTimestamp);
+}
+
+void UdpReceiver::receive (ReceiverShard& shard)
+{
+    shard.scheduling = scheduleThread (shard.index);
+
+    const int port = settings.port;
+    LOGD ("Attempting to listen on port ", port);
+
+    if (port == -1)
+        return;
+
+    // epoll backend: one receive buffer per datagram of a recvmmsg batch
+    const int batchSize = settings.batchSize;
+    std::vector<char> batchBuffers;
+    std::vector<char> controlBuffers;
+    std::vector<sockaddr_storage> senderNames; // only taken when senders are routed to streams
+    std::array<iovec, MAX_RECV_BATCH> iovecs {};
+    std::array<mmsghdr, MAX_RECV_BATCH> msgs {};
+
+    constexpr int MAX_EVENTS = 64;
+    std::array<epoll_event, MAX_EVENTS> events;
+
+    int sock = -1; // UDP socket
+    int sfd = -1;
+    int ep = -1;
+    FlushState flush;
+    flush.notifiedFrames = shard.framesPublished;
+
+    // The new socket counts its drops from zero
+    shard.kernelDropsBase = shard.kernelDrops.load (std::memory_order_relaxed);
+
+    sockaddr_storage addr {};
+    socklen_t addrLength = 0;
+    int yes = 1;
+    int no = 0;
+    sigset_t mask;
+    epoll_event ev {};
+    epoll_event sigEv {};
+    epoll_event timerEv {};
+    epoll_event stopEv {};
+
+    if (! getBindAddress (settings, port, addr, addrLength))
+        goto cleanup;
+
+    sock = ::socket (addr.ss_family, SOCK_DGRAM, 0);
+    if (sock == -1)
+    {
+        LOGD ("socket: ", strerror (errno));
+        goto cleanup;
+    }
+
+    // "::" takes IPv4 traffic too, as v4-mapped addresses, whatever net.ipv6.bindv6only says
+    if (addr.ss_family == AF_INET6)
+        setsockopt (sock, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof (no));
+
+    if (setNonblocking (sock) == -1)
+    {
+        LOGD ("fcntl(O_NONBLOCK)");
+        goto cleanup;
+    }
+
+    setsockopt (sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof (yes));
+    setsockopt (sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof (yes)); // lets every receiver bind the port
+
+    // Kernel receive time of every datagram, delivered with it as a control message
+    if (setsockopt (sock, SOL_SOCKET, SO_TIMESTAMPNS, &yes, sizeof (yes)) == -1)
+        LOGD ("SO_TIMESTAMPNS unavailable, timestamps will be taken per batch");
+
+    // Let the kernel coalesce a flow's datagrams into one receive (Linux 5.0+)
+    if (settings.gro && setsockopt (sock, SOL_UDP, UDP_GRO, &yes, sizeof (yes)) == -1)
+        LOGD ("UDP_GRO unavailable, datagrams will be received one by one");
+
+    // Datagrams carry the socket's running count of those dropped for a full queue
+    if (setsockopt (sock, SOL_SOCKET, SO_RXQ_OVFL, &yes, sizeof (yes)) == -1)
+        LOGD ("SO_RXQ_OVFL unavailable, kernel drops will not be counted");
+
+    if (settings.receiveBufferKb > 0)
+    {
+        // A deeper queue rides out stalls of the acquisition thread. SO_RCVBUFFORCE may
+        // exceed net.core.rmem_max but needs CAP_NET_ADMIN; SO_RCVBUF is capped by it
+        const int bytes = settings.receiveBufferKb * 1024;
+        if (setsockopt (sock, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof (bytes)) == -1)
+            setsockopt (sock, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof (bytes));
+
+        // The kernel reports twice the usable size, for its bookkeeping overhead
+        int actual = 0;
+        socklen_t actualLength = sizeof (actual);
+        getsockopt (sock, SOL_SOCKET, SO_RCVBUF, &actual, &actualLength);
+        LOGD ("Receive buffer ", actual / 2048, " KB (", settings.receiveBufferKb, " KB requested)");
+    }
+
+    // Spin on the device queue for this long before sleeping in a blocking wait;
+    // raising it above net.core.busy_read needs CAP_NET_ADMIN
+    if (settings.busyPollUs > 0 && setsockopt (sock, SOL_SOCKET, SO_BUSY_POLL, &settings.busyPollUs, sizeof (settings.busyPollUs)) == -1)
+        LOGD ("SO_BUSY_POLL: ", strerror (errno));
+
+    // A specific address keeps the socket to one NIC's traffic; bound to a
+    // multicast group, it ignores unicast traffic to the port
+    if (bind (sock, reinterpret_cast<sockaddr*> (&addr), addrLength) == -1)
+    {
+        LOGC ("Cannot bind to port ", port, ": ", strerror (errno));
+        goto cleanup;
+    }
+
+    if (! settings.multicastGroup.empty() && ! joinMulticastGroup (sock, addr, settings.multicastInterface))
+        goto cleanup;
+
+    // Create signalfd so we can shut down cleanly via epoll (Ctrl+C)
+    sigemptyset (&mask);
+    sigaddset (&mask, SIGINT);
+    sigaddset (&mask, SIGTERM);
+    // Block signals from default handling
+    if (pthread_sigmask (SIG_BLOCK, &mask, nullptr) != 0)
+    {
+        LOGD ("pthread_sigmask");
+        goto cleanup;
+    }
+    sfd = signalfd (-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd == -1)
+    {
+        LOGD ("signalfd");
+        goto cleanup;
+    }
+
+    flush.timerFd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (flush.timerFd == -1)
+    {
+        LOGD ("timerfd_create");
+        goto cleanup;
+    }
+
+    if (settings.backend == BACKEND_IO_URING)
+    {
+        if (receiveUring (shard, sock, sfd, flush))
+            goto cleanup;
+
+        LOGD ("io_uring multishot receive unavailable, using epoll");
+    }
+
+    batchBuffers.resize ((size_t) batchSize * MAX_DATAGRAM_SIZE);
+    controlBuffers.resize ((size_t) batchSize * CONTROL_BUFFER_SIZE);
+
+    if (senderStreams.isRouting())
+        senderNames.resize (batchSize);
+
+    for (int k = 0; k < batchSize; k++)
+    {
+        iovecs[k].iov_base = batchBuffers.data() + (size_t) k * MAX_DATAGRAM_SIZE;
+        iovecs[k].iov_len = MAX_DATAGRAM_SIZE;
+        msgs[k].msg_hdr.msg_iov = &iovecs[k];
+        msgs[k].msg_hdr.msg_iovlen = 1;
+        msgs[k].msg_hdr.msg_control = controlBuffers.data() + (size_t) k * CONTROL_BUFFER_SIZE;
+        msgs[k].msg_hdr.msg_name = senderNames.empty() ? nullptr : &senderNames[k];
+    }
+
+    // epoll setup
+    ep = epoll_create1 (EPOLL_CLOEXEC);
+    if (ep == -1)
+    {
+        LOGD ("epoll_create1");
+        goto cleanup;
+    }
+
+    ev.events = EPOLLIN | EPOLLET; // edge-triggered, read events
+    ev.data.fd = sock;
+    sigEv.events = EPOLLIN;
+    sigEv.data.fd = sfd;
+    timerEv.events = EPOLLIN;
+    timerEv.data.fd = flush.timerFd;
+    stopEv.events = EPOLLIN;
+    stopEv.data.fd = stopFd;
+
+    if (epoll_ctl (ep, EPOLL_CTL_ADD, sock, &ev) == -1
+        || epoll_ctl (ep, EPOLL_CTL_ADD, sfd, &sigEv) == -1
+        || epoll_ctl (ep, EPOLL_CTL_ADD, flush.timerFd, &timerEv) == -1
+        || epoll_ctl (ep, EPOLL_CTL_ADD, stopFd, &stopEv) == -1)
+    {
+        LOGD ("epoll_ctl");
+        goto cleanup;
+    }
+
+    LOGD ("UDP server listening on port ", port);
+
+    while (running)
+    {
+        int n = epoll_wait (ep, events.data(), MAX_EVENTS, -1);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            LOGD ("epoll_wait");
+            continue;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            int fd = events[i].data.fd;
+
+            if (fd == stopFd)
+            {
+                // stopThreads() has cleared running
+                break;
+            }
+
+            if (fd == sfd)
+            {
+                // Handle shutdown signal
+                signalfd_siginfo si;
+                ssize_t r = read (sfd, &si, sizeof (si));
+                (void) r;
+                running = false;
+                break;
+            }
+
+            if (fd == flush.timerFd)
+            {
+                onDeadline (shard, flush);
+                continue;
+            }
+
+            if (fd == sock)
+            {
+                // Drain all readable datagrams (edge-triggered!), batchSize per syscall
+                while (running)
+                {
+                    // The kernel shrinks msg_controllen and msg_namelen to what it wrote
+                    for (int k = 0; k < batchSize; k++)
+                    {
+                        msgs[k].msg_hdr.msg_controllen = CONTROL_BUFFER_SIZE;
+                        msgs[k].msg_hdr.msg_namelen = senderNames.empty() ? 0 : sizeof (sockaddr_storage);
+                    }
+
+                    int received = recvmmsg (sock, msgs.data(), batchSize, MSG_DONTWAIT, nullptr);
+
+                    if (received > 0)
+                    {
+                        // Only used if the kernel did not attach a timestamp
+                        const int64_t batchTimeNs = realtimeNowNs();
+
+                        for (int k = 0; k < received; k++)
+                        {
+                            if (msgs[k].msg_len == 0)
+                                continue;
+
+                            handleReceive (shard, (const char*) iovecs[k].iov_base, msgs[k].msg_len,
+                                           msgs[k].msg_hdr, batchTimeNs);
+                        }
+
+                        // A short batch means the socket queue is empty
+                        if (received < batchSize)
+                            break;
+                    }
+                    else if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    {
+                        // No more packets
+                        break;
+                    }
+                    else
+                    {
+                        LOGD ("recvmmsg");
+                        break;
+                    }
+                }
+
+                afterDatagrams (shard, flush);
+            }
+        }
+    }
+
+cleanup:
+    if (ep != -1)
+        close (ep);
+
+    if (flush.timerFd != -1)
+        close (flush.timerFd);
+
+    if (sfd != -1)
+        close (sfd);
+
+    if (sock != -1)
+        close (sock);
+
+    LOGD ("Closed UDP socket on port ", port);
+}
+
+bool UdpReceiver::receiveUring (ReceiverShard& shard, int sock, int sfd, FlushState& flush)
+{
+    // Completion tags
+    constexpr uint64_t RECEIVE = 1;
+    constexpr uint64_t DEADLINE = 2;
+    constexpr uint64_t SIGNAL = 3;
+    constexpr uint64_t STOP = 4;
+    constexpr uint16_t BUFFER_GROUP = 0;
+
+    IoUring ring;
+
+    // Each provided buffer holds the kernel's io_uring_recvmsg_out, the source address, the control data and the datagram
+    if (! ring.setup (64)
+        || ! ring.setupBufferRing (BUFFER_GROUP, URING_BUFFERS,
+                                   sizeof (io_uring_recvmsg_out) + sizeof (sockaddr_storage) + CONTROL_BUFFER_SIZE + MAX_DATAGRAM_SIZE))
+        return false;
+
+    // Template for every multishot receive: the source address only if senders are routed, room for the timestamp
+    msghdr receiveTemplate {};
+    receiveTemplate.msg_namelen = senderStreams.isRouting() ? sizeof (sockaddr_storage) : 0;
+    receiveTemplate.msg_controllen = CONTROL_BUFFER_SIZE;
+
+    // An entry to fill, submitting what is queued if the submission ring is full
+    auto getSqe = [&]
+    {
+        io_uring_sqe* sqe = ring.getSqe();
+
+        if (sqe == nullptr)
+        {
+            ring.submitAndWait (0);
+            sqe = ring.getSqe();
+        }
+
+        return sqe;
+    };
+
+    auto submitReceive = [&]
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (sqe == nullptr)
+            return false;
+
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = sock;
+        sqe->addr = (uint64_t) (uintptr_t) &receiveTemplate;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->user_data = RECEIVE;
+        return true;
+    };
+
+    auto submitPoll = [&] (int fd, uint64_t tag)
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (sqe == nullptr)
+            return false;
+
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = tag;
+        return true;
+    };
+
+    if (! submitReceive()
+        || ! submitPoll (flush.timerFd, DEADLINE)
+        || ! submitPoll (sfd, SIGNAL)
+        || ! submitPoll (stopFd, STOP)) // only ends the wait; stopThreads() has already cleared running
+        return false;
+
+    bool received = false; // a datagram has arrived, so multishot receives work
+
+    LOGD ("UDP server listening on port ", settings.port, " (io_uring)");
+
+    while (running)
+    {
+        const int result = ring.submitAndWait (1);
+        if (result < 0 && result != -EINTR && result != -EBUSY)
+        {
+            // The socket is still open; epoll carries on from here
+            LOGC ("Receiver ", shard.index, ": io_uring_enter failed (", strerror (-result), "), continuing with epoll");
+            return false;
+        }
+
+        // Only used if the kernel did not attach a timestamp
+        const int64_t batchTimeNs = realtimeNowNs();
+        bool gotDatagrams = false;
+
+        for (io_uring_cqe* cqe = ring.peekCqe(); cqe != nullptr; cqe = ring.peekCqe())
+        {
+            const uint64_t tag = cqe->user_data;
+            const int res = cqe->res;
+            const uint32_t flags = cqe->flags;
+            ring.cqeSeen();
+
+            if (tag == RECEIVE)
+            {
+                if (res >= 0 && (flags & IORING_CQE_F_BUFFER) != 0)
+                {
+                    const unsigned bufferId = flags >> IORING_CQE_BUFFER_SHIFT;
+                    char* buffer = ring.getBuffer (bufferId);
+
+                    io_uring_recvmsg_out out;
+                    memcpy (&out, buffer, sizeof (out));
+
+                    // Layout: io_uring_recvmsg_out, name, control data, payload
+                    char* name = buffer + sizeof (out);
+                    char* control = name + receiveTemplate.msg_namelen;
+                    const char* payload = control + receiveTemplate.msg_controllen;
+
+                    if (out.payloadlen > 0 && (out.flags & MSG_TRUNC) == 0)
+                    {
+                        msghdr hdr {};
+                        hdr.msg_name = name;
+                        hdr.msg_namelen = std::min (out.namelen, receiveTemplate.msg_namelen);
+                        hdr.msg_control = control;
+                        hdr.msg_controllen = out.controllen;
+
+                        handleReceive (shard, payload, out.payloadlen, hdr, batchTimeNs);
+                    }
+
+                    ring.recycleBuffer (bufferId);
+                    received = true;
+                    gotDatagrams = true;
+                }
+                else if (res < 0 && res != -ENOBUFS && ! received)
+                {
+                    // e.g. EINVAL before Linux 6.0, which has no multishot recvmsg
+                    return false;
+                }
+
+                // Out of buffers or otherwise ended: re-arm once buffers are back
+                if ((flags & IORING_CQE_F_MORE) == 0 && ! submitReceive())
+                {
+                    // The socket is still open; epoll carries on from here
+                    LOGC ("Receiver ", shard.index, ": io_uring submission queue full, continuing with epoll");
+                    return false;
+                }
+            }
+            else if (tag == DEADLINE)
+            {
+                onDeadline (shard, flush);
+
+                if ((flags & IORING_CQE_F_MORE) == 0 && ! submitPoll (flush.timerFd, DEADLINE))
+                {
+                    LOGC ("Receiver ", shard.index, ": io_uring submission queue full, continuing with epoll");
+                    return false;
+                }
+            }
+            else if (tag == SIGNAL)
+            {
+                signalfd_siginfo si;
+                ssize_t r = read (sfd, &si, sizeof (si));
+                (void) r;
+                running = false;
+            }
+        }
+
+        ring.publishBuffers();
+
+        if (gotDatagrams)
+            afterDatagrams (shard, flush);
+    }
+
+    return true;
+}
+
+void UdpReceiver::armDeadline (ReceiverShard& shard, FlushState& flush)
+{
+    // A partial block waits for the latency target if there is one, a reorder gap
+    // never longer than max_wait
+    const int target = targetLatencyUs;
+    int timeout = settings.maxWaitUs;
+
+    if (target > 0)
+        timeout = shard.isHolding() ? std::min (target, timeout) : target;
+
+    const itimerspec deadline = timerAfter (timeout);
+    timerfd_settime (flush.timerFd, 0, &deadline, nullptr);
+    flush.deadlineArmed = true;
+}
+
+void UdpReceiver::onDeadline (ReceiverShard& shard, FlushState& flush)
+{
+    uint64_t expirations;
+    ssize_t r = read (flush.timerFd, &expirations, sizeof (expirations));
+    (void) r;
+    flush.deadlineArmed = false;
+
+    // Stop waiting for missing packets that have been held too long
+    shard.flushExpired (std::chrono::duration_cast<std::chrono::nanoseconds> (
+                            std::chrono::steady_clock::now().time_since_epoch())
+                            .count(),
+                        settings.maxWaitUs * 1000LL);
+
+    if (shard.framesPublished > flush.notifiedFrames)
+    {
+        wakeConsumer();
+        flush.notifiedFrames = shard.framesPublished;
+    }
+
+    if (shard.isHolding())
+        armDeadline (shard, flush);
+}
+
+void UdpReceiver::afterDatagrams (ReceiverShard& shard, FlushState& flush)
+{
+    // Wake the consumer once this receiver's share of a block is queued,
+    // otherwise make sure a partial block (or a reorder gap) is resolved by
+    // the deadline
+    updateFlushThreshold (shard, std::chrono::duration_cast<std::chrono::nanoseconds> (
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+
+    if (shard.framesPublished - flush.notifiedFrames >= shard.flushThreshold.load (std::memory_order_relaxed))
+    {
+        wakeConsumer();
+        flush.notifiedFrames = shard.framesPublished;
+
+        if (flush.deadlineArmed && ! shard.isHolding())
+        {
+            const itimerspec disarmed {};
+            timerfd_settime (flush.timerFd, 0, &disarmed, nullptr);
+            flush.deadlineArmed = false;
+        }
+    }
+    else if ((shard.framesPublished > flush.notifiedFrames || shard.isHolding()) && ! flush.deadlineArmed)
+    {
+        armDeadline (shard, flush);
+    }
+}
+
+void UdpReceiver::replay()
+{
+    // Stands in for all receivers, so it takes the first one's core and reports for all
+    const ThreadScheduling scheduling = scheduleThread (0);
+    for (auto& shard : shards)
+        shard->scheduling = scheduling;
+
+    CaptureReader reader;
+    if (! reader.open (settings.replayFile, settings.port))
+    {
+        LOGD ("Cannot replay ", settings.replayFile);
+        return;
+    }
+
+    if (reader.getProtocol() != -1 && reader.getProtocol() != settings.protocol)
+        LOGD ("Capture was recorded with protocol ", reader.getProtocol(), ", replaying with ", settings.protocol);
+
+    LOGD ("Replaying ", settings.replayFile);
+
+    auto steadyNowNs = []
+    {
+        return (int64_t) std::chrono::duration_cast<std::chrono::nanoseconds> (
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    };
+
+    const double speed = settings.replaySpeed;
+    const int64_t maxWaitNs = settings.maxWaitUs * 1000LL;
+    const int numShards = (int) shards.size();
+
+    // Frames published before the consumer was last woken, and since when some are waiting
+    std::vector<int64_t> notifiedFrames (numShards);
+    std::vector<int64_t> pendingSinceNs (numShards, -1);
+
+    for (int s = 0; s < numShards; s++)
+        notifiedFrames[s] = shards[s]->framesPublished;
+
+    // Wakes the consumer for every shard whose partial block, or reorder gap, has waited long enough
+    auto flushDeadlines = [&] (int64_t nowNs)
+    {
+        const int target = targetLatencyUs;
+
+        for (int s = 0; s < numShards; s++)
+        {
+            ReceiverShard& shard = *shards[s];
+            shard.flushExpired (nowNs, maxWaitNs);
+
+            if (shard.framesPublished > notifiedFrames[s] && nowNs - pendingSinceNs[s] >= (target > 0 ? target * 1000LL : maxWaitNs))
+            {
+                wakeConsumer();
+                notifiedFrames[s] = shard.framesPublished;
+                pendingSinceNs[s] = -1;
+            }
+        }
+    };
+
+    // pcap senders are given streams as they would be on the network; capture
+    // records keep the stream they were recorded in, if there is still one
+    SenderCache replaySenders;
+    const bool routing = senderStreams.isRouting();
+
+    CaptureReader::Datagram datagram;
+    int64_t firstCaptureNs = 0;
+    int64_t startNs = 0;
+    bool first = true;
+
+    while (running && reader.next (datagram))
+    {
+        ReceiverShard& shard = *shards[datagram.receiver % numShards];
+        const int s = shard.index;
+        int stream = 0;
+
+        if (routing && datagram.hasSender)
+        {
+            bool assigned = false;
+            stream = replaySenders.lookup (datagram.sender, senderStreams, assigned);
+
+            if (assigned)
+                LOGC ("Sender ", datagram.sender.toString(), " feeds stream ", stream + 1);
+        }
+        else if (routing)
+        {
+            stream = datagram.senderStream < senderStreams.getNumStreams() ? datagram.senderStream : SenderStreams::NO_STREAM;
+        }
+
+        if (first)
+        {
+            firstCaptureNs = datagram.receiveTimeNs;
+            startNs = steadyNowNs();
+            first = false;
+        }
+
+        // Keep the captured spacing, scaled by the speed; partial blocks are
+        // still flushed on time while waiting for the next datagram
+        if (speed > 0)
+        {
+            const int64_t dueNs = startNs + (int64_t) ((datagram.receiveTimeNs - firstCaptureNs) / speed);
+
+            for (int64_t nowNs = steadyNowNs(); nowNs < dueNs; nowNs = steadyNowNs())
+            {
+                flushDeadlines (nowNs);
+
+                if (! sleepUnlessStopped (std::min<int64_t> (dueNs - nowNs, maxWaitNs / 4 + 1)))
+                    return;
+            }
+        }
+
+        if (stream == SenderStreams::NO_STREAM)
+        {
+            shard.unroutedPackets.fetch_add (1, std::memory_order_relaxed);
+            continue;
+        }
+
+        // Unlike a socket, a file can wait: never drop frames because the consumer is behind
+        constexpr size_t ROOM = FRAME_QUEUE_CAPACITY / 2;
+
+        while (shard.queue.writeAvailable (ROOM) < ROOM)
+        {
+            wakeConsumer();
+
+            if (! sleepUnlessStopped (100000))
+                return;
+        }
+
+        pushDatagram (shard, stream, datagram.data, datagram.length, datagram.receiveTimeNs * 1e-9);
+
+        const int64_t nowNs = steadyNowNs();
+        updateFlushThreshold (shard, nowNs);
+
+        if (shard.framesPublished - notifiedFrames[s] >= shard.flushThreshold.load (std::memory_order_relaxed))
+        {
+            wakeConsumer();
+            notifiedFrames[s] = shard.framesPublished;
+            pendingSinceNs[s] = -1;
+        }
+        else if (shard.framesPublished > notifiedFrames[s] && pendingSinceNs[s] == -1)
+        {
+            pendingSinceNs[s] = nowNs;
+        }
+    }
+
+    // End of the capture: release whatever is still held for a gap
+    for (auto& shard : shards)
+        shard->flushExpired (std::numeric_limits<int64_t>::max(), 0);
+
+    wakeConsumer();
+
+    LOGD ("Replay finished");
+}
+
+// ------------------------------------------------------------
+
+void UdpReceiver::updateFlushThreshold (ReceiverShard& shard, int64_t nowNs)
+{
+    const int target = targetLatencyUs;
+
+    // This receiver's share of the largest block the consumer reads, leaving the queue room to spare
+    const int limit = std::max (1, std::min (maxBlockSize.load(), (int) FRAME_QUEUE_CAPACITY / 2) / (int) shards.size());
+
+    if (target <= 0)
+    {
+        shard.flushThreshold.store (std::clamp (blockSize / (int) shards.size(), 1, limit), std::memory_order_relaxed);
+        return;
+    }
+
+    // Smoothed frame rate over windows of at least RATE_WINDOW_NS
+    const int64_t elapsed = nowNs - shard.rateWindowStartNs;
+
+    if (elapsed >= RATE_WINDOW_NS)
+    {
+        const double rate = (shard.framesPublished - shard.rateWindowFrames) * 1e9 / elapsed;
+
+        if (shard.rateWindowStartNs == 0)
+            shard.frameRate = 0; // first call only starts the window
+        else if (shard.frameRate == 0)
+            shard.frameRate = rate;
+        else
+            shard.frameRate += 0.25 * (rate - shard.frameRate);
+
+        shard.rateWindowStartNs = nowNs;
+        shard.rateWindowFrames = shard.framesPublished;
+    }
+
+    // Frames this receiver collects in target microseconds
+    const int threshold = (int) (shard.frameRate * target * 1e-6);
+    shard.flushThreshold.store (std::clamp (threshold, 1, limit), std::memory_order_relaxed);
+}
+
+int UdpReceiver::getQueuedFrames()
+{
+    int total = 0;
+
+    for (auto& shard : shards)
+        total += (int) shard->queue.readAvailable();
+
+    return total;
+}
+
+int UdpReceiver::getFlushThreshold() const
+{
+    int threshold = 0;
+
+    for (auto& shard : shards)
+        threshold += shard->flushThreshold.load (std::memory_order_relaxed);
+
+    return threshold;
+}
+
+bool UdpReceiver::waitForFrames (int timeoutMs)
+{
+    pollfd pfd {};
+    pfd.fd = wakeupFd;
+    pfd.events = POLLIN;
+
+    if (poll (&pfd, 1, timeoutMs) <= 0)
+        return false;
+
+    uint64_t count;
+    ssize_t r = read (wakeupFd, &count, sizeof (count));
+    (void) r;
+    return true;
+}
+
+void UdpReceiver::wakeConsumer()
+{
+    uint64_t one = 1;
+    ssize_t w = write (wakeupFd, &one, sizeof (one));
+    (void) w;
+}
+
+/*
+    Orders up to maxFrames queued frames by timestamp, as runs of consecutive
+    frames per shard. Only frames already queued are merged, so order across
+    shards holds within a block; blocks follow each other as quickly as the
+    receivers wake the consumer. Stores how many frames were taken from each
+    shard in taken.
+*/
+int UdpReceiver::mergeShards (const int* available, int* taken, int maxFrames)
+{
+    const int numShards = (int) shards.size();
+
+    for (int s = 0; s < numShards; s++)
+        taken[s] = 0;
+
+    mergeRuns.resize (maxFrames);
+
+    if (numShards == 1)
+    {
+        // Nothing to merge; anything beyond one block stays queued for the next call
+        taken[0] = std::min (available[0], maxFrames);
+        mergeRuns[0] = { 0, 0, taken[0] };
+        return taken[0] > 0 ? 1 : 0;
+    }
+
+    int total = 0;
+    int numRuns = 0;
+
+    while (total < maxFrames)
+    {
+        // Shard with the oldest head frame, and the head timestamp of the runner-up
+        int oldest = -1;
+        double oldestTime = std::numeric_limits<double>::max();
+        double nextTime = std::numeric_limits<double>::max();
+
+        for (int s = 0; s < numShards; s++)
+        {
+            if (taken[s] == available[s])
+                continue;
+
+            const double time = shards[s]->queue.readSlot (taken[s]).timestamp;
+
+            if (oldest == -1 || time < oldestTime)
+            {
+                nextTime = oldestTime;
+                oldest = s;
+                oldestTime = time;
+            }
+            else if (time < nextTime)
+            {
+                nextTime = time;
+            }
+        }
+
+        if (oldest == -1)
+            break;
+
+        // Take frames from that shard until another one's head is older
+        const SampleFrameQueue& queue = shards[oldest]->queue;
+        int count = 1;
+
+        while (taken[oldest] + count < available[oldest]
+               && total + count < maxFrames
+               && queue.readSlot (taken[oldest] + count).timestamp <= nextTime)
+            count++;
+
+        mergeRuns[numRuns++] = { oldest, taken[oldest], count };
+        taken[oldest] += count;
+        total += count;
+    }
+
+    return numRuns;
+}
+
+int UdpReceiver::readBlock (StreamBlock* blocks, int maxFrames)
+{
+    int available[MAX_RECEIVERS];
+    int taken[MAX_RECEIVERS];
+
+    for (size_t s = 0; s < shards.size(); s++)
+        available[s] = (int) shards[s]->queue.readAvailable();
+
+    const int numRuns = mergeShards (available, taken, maxFrames);
+    const int numStreams = senderStreams.getNumStreams();
+
+    int numFrames = 0;
+    for (int r = 0; r < numRuns; r++)
+        numFrames += mergeRuns[r].count;
+
+    // Each stream's block is as wide as the frames it gets, so count them first
+    for (int st = 0; st < numStreams; st++)
+        blocks[st].numFrames = 0;
+
+    if (numStreams == 1)
+    {
+        blocks[0].numFrames = numFrames;
+    }
+    else
+    {
+        for (int r = 0; r < numRuns; r++)
+        {
+            const MergeRun& run = mergeRuns[r];
+
+            for (int i = 0; i < run.count; i++)
+                blocks[shards[run.shard]->queue.readSlot (run.first + i).stream].numFrames++;
+        }
+    }
+
+    int filled[SenderStreams::MAX_STREAMS] = {};
+
+    for (int r = 0; r < numRuns; r++)
+    {
+        const MergeRun& run = mergeRuns[r];
+        const SampleFrameQueue& queue = shards[run.shard]->queue;
+
+        // Convert and transpose straight out of the queue; a run may wrap around its end
+        const int firstSpan = (int) queue.contiguousReadable (run.count, run.first);
+
+        decodeFrames (&queue.readSlot (run.first), firstSpan, run.shard, blocks, filled);
+
+        if (firstSpan < run.count)
+            decodeFrames (&queue.readSlot (run.first + firstSpan), run.count - firstSpan, run.shard, blocks, filled);
+    }
+
+    for (size_t s = 0; s < shards.size(); s++)
+        shards[s]->queue.release (taken[s]);
+
+    return numFrames;
+}
+
+void UdpReceiver::decodeFrames (const SampleFrame* frames, int count, int shard, StreamBlock* blocks, int* filled)
+{
+    // A single receiver keeps the sequencer's sample numbers. Merged streams are
+    // numbered consecutively, except that a jump in one receiver's numbers (a gap
+    // skipped with GAP_SKIP) carries over. Timestamps are the kernel receive time
+    // of each packet
+    const bool merged = shards.size() > 1;
+
+    // A stream keeps its format and senders send whole packets, so runs are long
+    for (int first = 0; first < count;)
+    {
+        const uint8_t format = frames[first].format;
+        const uint8_t stream = frames[first].stream;
+        int last = first + 1;
+
+        while (last < count && frames[last].format == format && frames[last].stream == stream)
+            last++;
+
+        StreamBlock& block = blocks[stream];
+        const int offset = filled[stream];
+
+        SampleDecoder::decode (frames + first, last - first, settings.channels, format, block.gains, block.offsets,
+                               block.dest + offset, block.numFrames);
+
+        for (int i = first; i < last; i++)
+        {
+            if (merged)
+            {
+                int64_t& previous = lastSampleNumbers[shard][stream];
+
+                if (previous >= 0 && frames[i].sampleNumber > previous + 1)
+                    mergedSampleNumbers[stream] += frames[i].sampleNumber - previous - 1;
+
+                previous = frames[i].sampleNumber;
+                block.sampleNumbers[offset + i - first] = mergedSampleNumbers[stream]++;
+            }
+            else
+            {
+                block.sampleNumbers[offset + i - first] = frames[i].sampleNumber;
+            }
+
+            block.timestamps[offset + i - first] = frames[i].timestamp;
+        }
+
+        filled[stream] += last - first;
+        first = last;
+    }
+}
+
+UdpReceiver::Counters UdpReceiver::getCounters() const
+{
+    Counters counters;
+
+    for (auto& shard : shards)
+    {
+        counters.droppedFrames += shard->droppedFrames.load (std::memory_order_relaxed);
+        counters.lostPackets += shard->getLostPackets();
+        counters.latePackets += shard->getLatePackets();
+        counters.duplicatePackets += shard->getDuplicatePackets();
+        counters.malformedPackets += shard->malformedPackets.load (std::memory_order_relaxed);
+        counters.kernelDrops += shard->kernelDrops.load (std::memory_order_relaxed);
+        counters.unroutedPackets += shard->unroutedPackets.load (std::memory_order_relaxed);
+    }
+
+    return counters;
+}
+
+ThreadScheduling UdpReceiver::getScheduling() const
+{
+    if (shards.empty())
+        return ThreadScheduling();
+
+    ThreadScheduling combined = shards[0]->scheduling;
+
+    for (auto& shard : shards)
+    {
+        const ThreadScheduling scheduling = shard->scheduling;
+        combined.priority = std::min (combined.priority, scheduling.priority);
+
+        if (scheduling.cpu < 0)
+            combined.cpu = -1;
+    }
+
+    return combined;
+}
@@ -0,0 +1,382 @@
+/*
+ ------------------------------------------------------------------
+
+ This file is part of the Open Ephys GUI
+ Copyright (C) 2022 Open Ephys
+
+ ------------------------------------------------------------------
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#ifndef UDPRECEIVER_H_DEFINED
+#define UDPRECEIVER_H_DEFINED
+
+#include <DataThreadHeaders.h>
+
+#include "PacketRecorder.h"
+#include "PacketSequencer.h"
+#include "SampleFrame.h"
+#include "SenderStreams.h"
+#include "ThreadScheduling.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** How datagrams are laid out, see the "protocol" parameter */
+enum PacketProtocol
+{
+    PROTOCOL_RAW = 0,   // one frame of samples in Settings::sampleFormat, no header
+    PROTOCOL_HEADER = 1 // PacketHeader followed by samplesPerPacket frames
+};
+
+struct msghdr;
+
+/** How receiver threads wait for and read datagrams */
+enum ReceiveBackend
+{
+    BACKEND_EPOLL = 0,   // edge-triggered epoll and recvmmsg batches
+    BACKEND_IO_URING = 1 // io_uring multishot recvmsg into provided buffers, epoll if unavailable
+};
+
+/** Where datagrams come from */
+enum PacketSource
+{
+    SOURCE_NETWORK = 0, // UDP sockets on the port
+    SOURCE_REPLAY = 1   // a capture or pcap file (see CaptureReader)
+};
+
+/**
+    Everything one receiver thread owns. Each receiver listens on its own
+    SO_REUSEPORT socket, so the kernel spreads senders across them, and
+    sequences and queues its packets independently of the others. Packets of
+    each sender stream are sequenced separately, but share the queue.
+*/
+class ReceiverShard
+{
+public:
+    ReceiverShard();
+
+    /** Empties the queue and restarts sequencing. Only safe while the receiver is stopped. */
+    void reset (int channels, int numStreams, int reorderWindow, PacketSequencer::GapPolicy gapPolicy, double samplePeriod);
+
+    /** Queues all frames of the run, tagged with stream, or, if there is not enough room, none of them */
+    void writeFrames (const PacketSequencer::FrameRun& run, int stream);
+
+    /** Sequencer of one sender stream */
+    PacketSequencer& getSequencer (int stream) { return streams[stream]->sequencer; }
+
+    /** True while any stream holds packets back waiting for a missing one */
+    bool isHolding() const;
+
+    /** PacketSequencer::flushExpired() on every stream */
+    void flushExpired (int64_t nowNs, int64_t maxAgeNs);
+
+    // Sequencer counters summed over the streams
+    int64_t getLostPackets() const;
+    int64_t getLatePackets() const;
+    int64_t getDuplicatePackets() const;
+
+    SampleFrameQueue queue;
+    std::atomic<int64_t> droppedFrames { 0 };
+    std::atomic<int64_t> malformedPackets { 0 }; // failed header validation
+    std::atomic<int64_t> kernelDrops { 0 };      // dropped by the kernel, socket queue full
+    std::atomic<int64_t> unroutedPackets { 0 };  // from senders that found no stream
+
+    /** Frames this receiver queues before it wakes the consumer */
+    std::atomic<int> flushThreshold { 1 };
+
+    /** What the receiver thread got of the requested core and priority */
+    std::atomic<ThreadScheduling> scheduling { ThreadScheduling() };
+
+    int index = 0; // position in UdpReceiver::shards
+
+    // Receiver thread only
+    int channels = 1;
+    int64_t framesPublished = 0; // written to queue since the last reset
+    double frameRate = 0;        // frames per second, smoothed
+    int64_t rateWindowStartNs = 0;
+    int64_t rateWindowFrames = 0;
+    int64_t kernelDropsBase = 0; // drops counted by sockets closed since the reset
+    SenderCache senders;         // stream of each sender seen
+
+private:
+    /** Feeds one stream's sequenced frames into the shard's queue */
+    struct Stream : PacketSequencer::Output
+    {
+        Stream (ReceiverShard& shard, int index);
+
+        void writeFrames (const PacketSequencer::FrameRun& run) override { shard.writeFrames (run, index); }
+
+        ReceiverShard& shard;
+        int index;
+        PacketSequencer sequencer;
+    };
+
+    std::array<std::unique_ptr<Stream>, SenderStreams::MAX_STREAMS> streams;
+    int numStreams = 1;
+};
+
+/**
+    Receives sample frames over UDP on one or more receiver threads and hands
+    them to a single consumer (the acquisition thread) in blocks.
+
+    Receiver threads only run between start() and stop(); the destructor
+    stops them, so they never outlive the object. In replay mode a single
+    thread reads a capture file instead and feeds its datagrams to the
+    receivers' queues, through the same decoding and sequencing.
+*/
+class UdpReceiver
+{
+public:
+    /** Configuration applied by start() */
+    struct Settings
+    {
+        int port = 8080;
+        std::string bindAddress;        // local IPv4 or IPv6 address, "::" for dual-stack; empty for any IPv4 address
+        std::string multicastGroup;     // IPv4 or IPv6 group to join, empty for unicast
+        std::string multicastInterface; // address or name of the interface to join it on, empty for the routed one
+        int channels = 1;
+        int protocol = PROTOCOL_RAW;
+        int sampleFormat = (int) PacketSampleFormat::INT16_LE; // of Raw protocol datagrams; headers carry their own
+        int batchSize = 16;     // datagrams per recvmmsg call
+        int receivers = 1;      // receiver threads / sockets
+        int reorderWindow = 8;
+        int gapPolicy = PacketSequencer::GAP_ZERO;
+        int maxWaitUs = 2000;   // longest a partial block or a reorder gap waits
+        double sampleRate = 30000.0;
+        int backend = BACKEND_EPOLL;
+        bool gro = true;        // UDP_GRO, where the kernel supports it
+        int receiveBufferKb = 0; // SO_RCVBUF(FORCE), 0 keeps the kernel default
+        int busyPollUs = 0;     // SO_BUSY_POLL, 0 disables it
+        int source = SOURCE_NETWORK;
+        std::string replayFile;
+        double replaySpeed = 1.0; // multiple of the captured pace, 0 = as fast as the consumer reads
+        int receiverCpu = -1;     // core of the first receiver, the others take the next ones; -1 unpinned
+        int receiverPriority = 0; // SCHED_FIFO priority of receiver threads, 0 for normal scheduling
+        int streams = 1;          // sender streams the packets are split into (see SenderStreams)
+        std::string streamSenders; // senders tied to the first streams, see SenderStreams::parseSenders()
+    };
+
+    /** Where readBlock() puts the frames of one sender stream */
+    struct StreamBlock
+    {
+        float* dest;          // channel-major, numFrames samples per channel
+        int64* sampleNumbers;
+        double* timestamps;
+        const float* gains;   // per channel: value = sample * gains[channel] + offsets[channel]
+        const float* offsets;
+        int numFrames;        // set by readBlock()
+    };
+
+    /** Packet accounting summed over all receivers */
+    struct Counters
+    {
+        int64 droppedFrames = 0;
+        int64 lostPackets = 0;
+        int64 latePackets = 0;
+        int64 duplicatePackets = 0;
+        int64 malformedPackets = 0;
+        int64 kernelDrops = 0; // datagrams the kernel dropped because a socket queue was full
+        int64 unroutedPackets = 0; // from senders that found no stream
+    };
+
+    static constexpr int MAX_DATAGRAM_SIZE = 65536; // max UDP payload size
+    static constexpr int MAX_RECV_BATCH = 64;
+    static constexpr unsigned URING_BUFFERS = 64; // provided receive buffers per io_uring receiver
+    static constexpr int CONTROL_BUFFER_SIZE = 256; // per-datagram ancillary data (timestamps...)
+    static constexpr int MAX_RECEIVERS = 16;
+    static constexpr int64_t RATE_WINDOW_NS = 20000000; // frame rate measurement interval
+
+    UdpReceiver();
+    ~UdpReceiver();
+
+    /** Resets all queues and counters and starts the receiver threads */
+    void start (const Settings& settings);
+
+    /** Stops the receiver threads and waits for them to exit */
+    void stop();
+
+    /** Reopens the sockets on a new port without touching queued frames */
+    void setPort (int port);
+
+    bool isRunning() const { return running; }
+
+    /** Number of sender streams, as of the last start() */
+    int getNumStreams() const { return senderStreams.getNumStreams(); }
+
+    /** Frames the receivers together queue before waking the consumer; may change at any time */
+    void setBlockSize (int frames) { blockSize = frames; }
+
+    /**
+        With a latency target (microseconds, 0 disables it) the block size
+        follows the measured frame rate so a block spans about that long, and a
+        partial block waits at most that long. May change at any time.
+    */
+    void setTargetLatency (int microseconds) { targetLatencyUs = microseconds; }
+
+    /**
+        Most frames the consumer takes per readBlock(). A block never grows
+        beyond it, whatever the block size or latency target, since the
+        consumer could not drain a larger one per wakeup and a backlog would
+        build up. May change at any time.
+    */
+    void setMaxBlockSize (int frames) { maxBlockSize = frames; }
+
+    /**
+        Every datagram received is also handed to recorder (nullptr disables
+        capture). Only call while stopped; the recorder must already be
+        started and must outlive the receiver threads.
+    */
+    void setRecorder (PacketRecorder* recorder_) { recorder = recorder_; }
+
+    // ------------------------------------------------------------
+    //                  CONSUMER THREAD ONLY
+    // ------------------------------------------------------------
+
+    /** Returns the number of frames queued by all receivers */
+    int getQueuedFrames();
+
+    /** Returns how many queued frames make a full block, for the current hold mode */
+    int getFlushThreshold() const;
+
+    /** Blocks until a receiver signals new frames or timeoutMs elapses */
+    bool waitForFrames (int timeoutMs);
+
+    /** Makes a pending waitForFrames() return, e.g. to stop acquisition */
+    void wakeConsumer();
+
+    /**
+        Removes up to maxFrames queued frames, merged by timestamp across
+        receivers, and converts them to float into the block of their stream,
+        one per stream, each with room for maxFrames. Returns the number of
+        frames read; each block's numFrames says how many it got.
+    */
+    int readBlock (StreamBlock* blocks, int maxFrames);
+
+    Counters getCounters() const;
+
+    /**
+        Returns the scheduling the receiver threads got: the lowest priority
+        any of them runs at, and the first one's core if all are pinned.
+        Call from the thread that starts and stops the receiver.
+    */
+    ThreadScheduling getScheduling() const;
+
+private:
+    /** Consecutive frames of one shard's queue that are next in the merged block */
+    struct MergeRun
+    {
+        int shard;
+        int first; // index into the shard's readable slots
+        int count;
+    };
+
+    /** Flush bookkeeping of one receiver thread */
+    struct FlushState
+    {
+        int timerFd = -1; // deadline for a partial block or a reorder gap
+        bool deadlineArmed = false;
+        int64_t notifiedFrames = 0; // frames published before the consumer was last woken
+    };
+
+    /** Starts one thread per shard on the configured port */
+    void startThreads();
+
+    /** Signals every receiver thread to exit and joins them */
+    void stopThreads();
+
+    /** Sleeps for up to ns nanoseconds; returns false, at once, if the threads are told to stop */
+    bool sleepUnlessStopped (int64_t ns);
+
+    /** Pins and prioritises the calling thread as receiver index of the settings; logs what is refused */
+    ThreadScheduling scheduleThread (int index);
+
+    /** Body of a receiver thread */
+    void receive (ReceiverShard& shard);
+
+    /**
+        Receive loop of a receiver thread on io_uring. Returns false if the
+        kernel lacks what it needs (before taking any datagram) or the ring
+        fails later on, so the thread can carry on with epoll.
+    */
+    bool receiveUring (ReceiverShard& shard, int sock, int signalFd, FlushState& flush);
+
+    /** Starts the flush deadline timer */
+    void armDeadline (ReceiverShard& shard, FlushState& flush);
+
+    /** Handles an expired flush deadline */
+    void onDeadline (ReceiverShard& shard, FlushState& flush);
+
+    /** Wakes the consumer or arms the deadline after a round of datagrams */
+    void afterDatagrams (ReceiverShard& shard, FlushState& flush);
+
+    /** Body of the replay thread, which stands in for all receiver threads */
+    void replay();
+
+    /**
+        Handles what one receive call returned: takes the kernel receive time
+        (or fallbackNs) from the control messages and, if GRO coalesced several
+        datagrams, splits them again before recording and decoding each.
+    */
+    void handleReceive (ReceiverShard& shard, const char* data, size_t length, const msghdr& hdr, int64_t fallbackNs);
+
+    /**
+        Decodes one datagram according to the protocol and hands its frames to
+        the shard's sequencer of stream. received is when the datagram
+        arrived, which is taken as the time of its last frame.
+    */
+    void pushDatagram (ReceiverShard& shard, int stream, const char* data, size_t length, double received);
+
+    /** Re-derives a shard's flush threshold from the hold mode and its frame rate */
+    void updateFlushThreshold (ReceiverShard& shard, int64_t nowNs);
+
+    /**
+        Decodes contiguous queued frames into the blocks of their streams, with
+        the kernel for each one's sample format; filled counts the frames each
+        block already has. shard is the receiver they were queued by.
+    */
+    void decodeFrames (const SampleFrame* frames, int count, int shard, StreamBlock* blocks, int* filled);
+
+    /** Orders up to maxFrames queued frames by timestamp into mergeRuns; returns the number of runs */
+    int mergeShards (const int* available, int* taken, int maxFrames);
+
+    Settings settings;
+    std::vector<std::unique_ptr<ReceiverShard>> shards; // only resized while stopped
+
+    std::atomic<int> blockSize { 300 };
+    std::atomic<int> targetLatencyUs { 0 };
+    std::atomic<int> maxBlockSize { (int) FRAME_QUEUE_CAPACITY / 2 };
+    std::atomic<bool> running { false };
+    std::vector<std::thread> threads; // receiver or replay threads, joined by stopThreads()
+    PacketRecorder* recorder = nullptr;
+    SenderStreams senderStreams; // configured by start()
+    int wakeupFd = -1; // eventfd the receivers use to wake the consumer
+    int stopFd = -1;   // eventfd, readable from stopThreads() until the threads are joined
+
+    // Consumer thread only
+    std::vector<MergeRun> mergeRuns;
+    std::array<int64_t, SenderStreams::MAX_STREAMS> mergedSampleNumbers {}; // next of each stream when several receivers are merged
+
+    /** Sequencer sample number of the last frame merged from each receiver and stream, -1 before the first */
+    std::array<std::array<int64_t, SenderStreams::MAX_STREAMS>, MAX_RECEIVERS> lastSampleNumbers;
+};
+
+#endif